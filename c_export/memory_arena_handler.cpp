@@ -1,17 +1,95 @@
 #include "memory_arena_handler.h"
 #include "memory_arena_handler.hpp"
 
-#include <cstring>
+#include <new>
 
 static inline mem_arena_handler::ArenaHandler* to_cpp(CArenaHandler* handler)
 {
 	return (mem_arena_handler::ArenaHandler*)handler;
 }
 
+static inline ArenaErrorCode to_c(const mem_arena_handler::ErrorCode result)
+{
+	switch (result)
+	{
+		case (mem_arena_handler::ErrorCode::Success):
+		{
+			return ARENA_SUCCESS;
+		}
+
+		case (mem_arena_handler::ErrorCode::InsufficientResource):
+		{
+			return ARENA_INSUFFICIENT_RESOURCE;
+		}
+
+		case (mem_arena_handler::ErrorCode::OutOfMemory):
+		{
+			return ARENA_OUT_OF_MEMORY;
+		}
+
+		case (mem_arena_handler::ErrorCode::InvalidArgument):
+		{
+			return ARENA_INVALID_ARGUMENT;
+		}
+	}
+
+	return ARENA_INVALID_ARGUMENT;
+}
+
 extern "C"
 {
 	CArenaHandler* arena_create()
 	{
+		return arena_create_with_config(nullptr);
+	}
+
+	void arena_config_init(ArenaConfig* config)
+	{
+		const mem_arena_handler::ArenaHandlerConfig defaults;
+		config->arena_size = defaults.arena_size;
+		config->request_growth_factor = defaults.request_growth_factor;
+		config->arena_growth_factor = defaults.arena_growth_factor;
+		config->max_arena_size = defaults.max_arena_size;
+		config->initial_arenas_capacity = defaults.initial_arenas_capacity;
+		config->min_free_block_size = defaults.min_free_block_size;
+		config->arena_retire_threshold = defaults.arena_retire_threshold;
+		config->purge_threshold = defaults.purge_threshold;
+		config->retained_free_arenas = defaults.retained_free_arenas;
+		config->arena_decay_ms = defaults.arena_decay_ms;
+		config->arena_backing = (ArenaBackingKind)defaults.arena_backing;
+		config->upstream_acquire = defaults.upstream.acquire;
+		config->upstream_release = defaults.upstream.release;
+		config->upstream_user_data = defaults.upstream.user_data;
+		config->reservation_size = defaults.reservation_size;
+		config->mode = (ArenaAllocationMode)defaults.mode;
+		config->track_allocation_sizes = defaults.track_allocation_sizes;
+	}
+
+	CArenaHandler* arena_create_with_config(const ArenaConfig* config)
+	{
+		mem_arena_handler::ArenaHandlerConfig cpp_config;
+		if (config != nullptr)
+		{
+			cpp_config.arena_size = config->arena_size;
+			cpp_config.request_growth_factor = config->request_growth_factor;
+			cpp_config.arena_growth_factor = config->arena_growth_factor;
+			cpp_config.max_arena_size = config->max_arena_size;
+			cpp_config.initial_arenas_capacity = config->initial_arenas_capacity;
+			cpp_config.min_free_block_size = config->min_free_block_size;
+			cpp_config.arena_retire_threshold = config->arena_retire_threshold;
+			cpp_config.purge_threshold = config->purge_threshold;
+			cpp_config.retained_free_arenas = config->retained_free_arenas;
+			cpp_config.arena_decay_ms = config->arena_decay_ms;
+			cpp_config.arena_backing =
+				(mem_arena_handler::ArenaBacking)config->arena_backing;
+			cpp_config.upstream.acquire = config->upstream_acquire;
+			cpp_config.upstream.release = config->upstream_release;
+			cpp_config.upstream.user_data = config->upstream_user_data;
+			cpp_config.reservation_size = config->reservation_size;
+			cpp_config.mode = (mem_arena_handler::AllocationMode)config->mode;
+			cpp_config.track_allocation_sizes = config->track_allocation_sizes;
+		}
+
 		mem_arena_handler::ArenaHandler* handler =
 			(mem_arena_handler::ArenaHandler*)malloc(
 				sizeof(mem_arena_handler::ArenaHandler));
@@ -20,7 +98,8 @@ extern "C"
 			return nullptr;
 		}
 
-		memset((void*)handler, 0, sizeof(mem_arena_handler::ArenaHandler));
+		// Placement new, as some members have non-zero defaults.
+		new (handler) mem_arena_handler::ArenaHandler(cpp_config);
 		return (CArenaHandler*)handler;
 	}
 
@@ -42,22 +121,37 @@ extern "C"
 	ArenaErrorCode arena_free(CArenaHandler* handler, void* ptr, size_t size)
 	{
 		mem_arena_handler::ArenaHandler* arena_handler = to_cpp(handler);
-		switch (arena_handler->free_memory(ptr, size))
-		{
-			case (mem_arena_handler::ErrorCode::Success):
-			{
-				return ARENA_SUCCESS;
-			}
-
-			case (mem_arena_handler::ErrorCode::InsufficientResource):
-			{
-				return ARENA_INSUFFICIENT_RESOURCE;
-			}
-
-			case (mem_arena_handler::ErrorCode::OutOfMemory):
-			{
-				return ARENA_OUT_OF_MEMORY;
-			}
-		}
+		return to_c(arena_handler->free_memory(ptr, size));
+	}
+
+	ArenaErrorCode arena_free_unsized(CArenaHandler* handler, void* ptr)
+	{
+		mem_arena_handler::ArenaHandler* arena_handler = to_cpp(handler);
+		return to_c(arena_handler->free_memory(ptr));
+	}
+
+	size_t arena_usable_size(CArenaHandler* handler, void* ptr)
+	{
+		mem_arena_handler::ArenaHandler* arena_handler = to_cpp(handler);
+		return arena_handler->usable_size(ptr);
+	}
+
+	size_t arena_trim(CArenaHandler* handler)
+	{
+		mem_arena_handler::ArenaHandler* arena_handler = to_cpp(handler);
+		return arena_handler->trim();
+	}
+
+	size_t arena_purge_free_blocks(CArenaHandler* handler)
+	{
+		mem_arena_handler::ArenaHandler* arena_handler = to_cpp(handler);
+		return arena_handler->purge_free_blocks();
+	}
+
+	ArenaErrorCode arena_add_seed_block(
+		CArenaHandler* handler, void* mem, size_t size)
+	{
+		mem_arena_handler::ArenaHandler* arena_handler = to_cpp(handler);
+		return to_c(arena_handler->add_seed_block(mem, size));
 	}
 }
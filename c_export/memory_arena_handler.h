@@ -31,13 +31,60 @@ extern "C"
 	{
 		ARENA_SUCCESS = 0,
 		ARENA_OUT_OF_MEMORY = 1,
-		ARENA_INSUFFICIENT_RESOURCE = 2
+		ARENA_INSUFFICIENT_RESOURCE = 2,
+		ARENA_INVALID_ARGUMENT = 3
 	} ArenaErrorCode;
 
+	typedef enum
+	{
+		ARENA_BACKING_MALLOC = 0,
+		ARENA_BACKING_MMAP = 1,
+		ARENA_BACKING_MMAP_HUGETLB = 2,
+		ARENA_BACKING_RESERVED = 3,
+		ARENA_BACKING_UPSTREAM = 4,
+		ARENA_BACKING_SEEDED = 5
+	} ArenaBackingKind;
+
+	typedef enum
+	{
+		ARENA_MODE_SEGREGATED_FIT = 0,
+		ARENA_MODE_TLSF = 1
+	} ArenaAllocationMode;
+
+	// Mirrors mem_arena_handler::ArenaHandlerConfig. Fill it with
+	// arena_config_init before changing individual fields.
+	typedef struct
+	{
+		size_t arena_size;
+		uint8_t request_growth_factor;
+		uint8_t arena_growth_factor;
+		size_t max_arena_size;
+		uint32_t initial_arenas_capacity;
+		size_t min_free_block_size;
+		size_t arena_retire_threshold;
+		size_t purge_threshold;
+		uint16_t retained_free_arenas;
+		uint32_t arena_decay_ms;
+		ArenaBackingKind arena_backing;
+
+		// Used by ARENA_BACKING_UPSTREAM, see mem_arena_handler::UpstreamAllocator.
+		void* (*upstream_acquire)(size_t size, void* user_data);
+		void (*upstream_release)(void* mem, size_t size, void* user_data);
+		void* upstream_user_data;
+
+		size_t reservation_size;
+		ArenaAllocationMode mode;
+		bool track_allocation_sizes;
+	} ArenaConfig;
+
 	// Apply the macro to every function declaration
 
 	ARENA_API CArenaHandler* arena_create(void);
 
+	ARENA_API void arena_config_init(ArenaConfig* config);
+
+	ARENA_API CArenaHandler* arena_create_with_config(const ArenaConfig* config);
+
 	ARENA_API void arena_destroy(CArenaHandler* handler);
 
 	ARENA_API void* arena_alloc(CArenaHandler* handler, size_t size,
@@ -46,6 +93,28 @@ extern "C"
 	ARENA_API ArenaErrorCode arena_free(
 		CArenaHandler* handler, void* ptr, size_t size);
 
+	// Frees `ptr` without its size. Needs the TLSF mode or
+	// track_allocation_sizes; otherwise returns ARENA_INVALID_ARGUMENT.
+	ARENA_API ArenaErrorCode arena_free_unsized(
+		CArenaHandler* handler, void* ptr);
+
+	// Returns how many bytes may be used at `ptr`, or 0 when sizes aren't
+	// tracked.
+	ARENA_API size_t arena_usable_size(CArenaHandler* handler, void* ptr);
+
+	// Releases every fully free arena right away, ignoring retained_free_arenas
+	// and arena_decay_ms. Returns the number of bytes released.
+	ARENA_API size_t arena_trim(CArenaHandler* handler);
+
+	// Hands the whole pages inside free blocks of at least purge_threshold bytes
+	// back to the system. Returns the number of bytes purged.
+	ARENA_API size_t arena_purge_free_blocks(CArenaHandler* handler);
+
+	// Adds a caller-owned block the handler never frees. It must outlive the
+	// handler.
+	ARENA_API ArenaErrorCode arena_add_seed_block(
+		CArenaHandler* handler, void* mem, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
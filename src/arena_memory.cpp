@@ -0,0 +1,225 @@
+#include "arena_memory.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define ARENA_HAS_MMAP 1
+#else
+#define ARENA_HAS_MMAP 0
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace mem_arena_handler
+{
+
+constexpr size_t HUGE_PAGE_SIZE = 1 << 21;
+
+#if ARENA_HAS_MMAP
+
+/**
+ * @brief Maps `size` bytes starting on a huge page boundary, or returns nullptr.
+ *
+ * A huge page more than needed is mapped, and the misaligned head and the tail
+ * are unmapped again, so the kernel can back the arena with huge pages from its
+ * first byte. Reserved mappings are inaccessible and don't count against the
+ * commit limit.
+ **/
+[[nodiscard]]
+static int8_t* map_aligned(const size_t size, const bool reserve_only)
+{
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+	if (reserve_only)
+	{
+		flags |= MAP_NORESERVE;
+	}
+#endif
+
+	const size_t mapped_size = size + HUGE_PAGE_SIZE;
+	void* mem = mmap(nullptr, mapped_size,
+		reserve_only ? PROT_NONE : PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (mem == MAP_FAILED)
+	{
+		return nullptr;
+	}
+
+	const uintptr_t start = (uintptr_t)mem;
+	const uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+	const size_t head = aligned - start;
+	const size_t tail = mapped_size - head - size;
+	if (head != 0)
+	{
+		munmap(mem, head);
+	}
+
+	if (tail != 0)
+	{
+		munmap((void*)(aligned + size), tail);
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (!reserve_only)
+	{
+		madvise((void*)aligned, size, MADV_HUGEPAGE);
+	}
+#endif
+
+	return (int8_t*)aligned;
+}
+
+/**
+ * @brief Maps `size` bytes from the reserved huge page pool, or returns nullptr
+ * if it is empty or unsupported.
+ **/
+[[nodiscard]]
+static int8_t* map_huge_tlb(const size_t size)
+{
+#ifdef MAP_HUGETLB
+	void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	return mem == MAP_FAILED ? nullptr : (int8_t*)mem;
+#else
+	(void)size;
+	return nullptr;
+#endif
+}
+
+#endif // ARENA_HAS_MMAP
+
+int8_t* allocate_arena_memory(size_t& size, ArenaBacking& backing)
+{
+#if ARENA_HAS_MMAP
+	if (backing != ArenaBacking::Malloc)
+	{
+		size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+		if (backing == ArenaBacking::MmapHugeTlb)
+		{
+			if (int8_t* mem = map_huge_tlb(size); mem != nullptr)
+			{
+				return mem;
+			}
+
+			backing = ArenaBacking::Mmap;
+		}
+
+		return map_aligned(size, backing == ArenaBacking::Reserved);
+	}
+#elif defined(_WIN32)
+	if (backing == ArenaBacking::Reserved)
+	{
+		size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+		return (int8_t*)VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+	}
+#endif
+
+	backing = ArenaBacking::Malloc;
+	return (int8_t*)malloc(size);
+}
+
+bool commit_arena_memory(int8_t* mem, const size_t size)
+{
+#if ARENA_HAS_MMAP
+	if (mprotect(mem, size, PROT_READ | PROT_WRITE) != 0)
+	{
+		return false;
+	}
+
+#ifdef MADV_HUGEPAGE
+	madvise(mem, size, MADV_HUGEPAGE);
+#endif
+
+	return true;
+#elif defined(_WIN32)
+	return VirtualAlloc(mem, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+	(void)mem;
+	(void)size;
+	return false;
+#endif
+}
+
+size_t purge_arena_memory(int8_t* mem, const size_t size)
+{
+#if ARENA_HAS_MMAP
+	static const uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+	const uintptr_t start = ((uintptr_t)mem + page_size - 1) & ~(page_size - 1);
+	const uintptr_t end = ((uintptr_t)mem + size) & ~(page_size - 1);
+	if (end <= start)
+	{
+		return 0;
+	}
+
+#ifdef MADV_FREE
+	if (madvise((void*)start, end - start, MADV_FREE) == 0)
+	{
+		return end - start;
+	}
+#endif
+
+	return madvise((void*)start, end - start, MADV_DONTNEED) == 0 ? end - start : 0;
+#else
+	(void)mem;
+	(void)size;
+	return 0;
+#endif
+}
+
+void decommit_arena_memory(int8_t* mem, const size_t size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+#if ARENA_HAS_MMAP
+	madvise(mem, size, MADV_DONTNEED);
+	mprotect(mem, size, PROT_NONE);
+#elif defined(_WIN32)
+	VirtualFree(mem, size, MEM_DECOMMIT);
+#else
+	(void)mem;
+#endif
+}
+
+void release_arena_memory(int8_t* mem, const size_t size, const ArenaBacking backing)
+{
+	// Upstream arenas go back through their callbacks, and seed blocks belong to
+	// the caller.
+	if (backing == ArenaBacking::Upstream || backing == ArenaBacking::Seeded)
+	{
+		return;
+	}
+
+#if ARENA_HAS_MMAP
+	if (backing != ArenaBacking::Malloc)
+	{
+		if (mem != nullptr)
+		{
+			munmap(mem, size);
+		}
+
+		return;
+	}
+#elif defined(_WIN32)
+	(void)size;
+	if (backing == ArenaBacking::Reserved)
+	{
+		if (mem != nullptr)
+		{
+			VirtualFree(mem, 0, MEM_RELEASE);
+		}
+
+		return;
+	}
+#else
+	(void)size;
+	(void)backing;
+#endif
+
+	free(mem);
+}
+
+} // namespace mem_arena_handler
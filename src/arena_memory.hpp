@@ -0,0 +1,52 @@
+#ifndef ARENA_MEMORY_HPP
+#define ARENA_MEMORY_HPP
+
+#include "memory_arena_handler.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace mem_arena_handler
+{
+
+// Reserved arenas are committed in steps of this many bytes.
+constexpr size_t ARENA_COMMIT_GRANULARITY = 1 << 21;
+
+/**
+ * @brief Allocates memory for an arena of at least `size` bytes, or returns
+ * nullptr on failure.
+ *
+ * Mapped backings round `size` up to whole huge pages. If a backing is
+ * unavailable, `backing` falls back to the next one down. Both are updated to
+ * what was actually obtained. Reserved memory is inaccessible until committed.
+ **/
+[[nodiscard]]
+int8_t* allocate_arena_memory(size_t& size, ArenaBacking& backing);
+
+/**
+ * @brief Makes [mem, mem + size) of a Reserved arena readable and writable.
+ *
+ * Returns false if the system couldn't commit the memory.
+ **/
+[[nodiscard]]
+bool commit_arena_memory(int8_t* mem, const size_t size);
+
+/**
+ * @brief Lets the system reclaim the whole pages inside [mem, mem + size), which
+ * stay mapped and read back as zero or their old contents.
+ *
+ * Returns the number of bytes purged, or 0 if purging is unsupported.
+ **/
+size_t purge_arena_memory(int8_t* mem, const size_t size);
+
+/**
+ * @brief Returns the pages of [mem, mem + size) of a Reserved arena to the
+ * system, leaving the range reserved but inaccessible.
+ **/
+void decommit_arena_memory(int8_t* mem, const size_t size);
+
+void release_arena_memory(int8_t* mem, const size_t size, const ArenaBacking backing);
+
+} // namespace mem_arena_handler
+
+#endif // ARENA_MEMORY_HPP
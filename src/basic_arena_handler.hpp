@@ -0,0 +1,521 @@
+#ifndef BASIC_ARENA_HANDLER_HPP
+#define BASIC_ARENA_HANDLER_HPP
+
+#include "arena_memory.hpp"
+#include "memory_arena_handler.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+namespace mem_arena_handler
+{
+
+/**
+ * Policies for BasicArenaHandler, which picks its allocator, backing, locking
+ * and statistics at compile time. Whatever a policy doesn't need compiles away:
+ * NoLock and NoStats are empty inline calls, and a bump handler never links the
+ * free block machinery.
+ **/
+
+/**
+ * @brief Backing policy, choosing how arenas obtain their memory.
+ **/
+template <ArenaBacking backing_kind>
+struct BackingPolicy
+{
+	static constexpr ArenaBacking backing = backing_kind;
+};
+
+using MallocBacking = BackingPolicy<ArenaBacking::Malloc>;
+using MmapBacking = BackingPolicy<ArenaBacking::Mmap>;
+using MmapHugeTlbBacking = BackingPolicy<ArenaBacking::MmapHugeTlb>;
+using ReservedBacking = BackingPolicy<ArenaBacking::Reserved>;
+
+/**
+ * @brief Free list policy running a full ArenaHandler in `allocation_mode`.
+ *
+ * The handler is public so the rest of its tuning can still be changed before
+ * the first request.
+ **/
+template <AllocationMode allocation_mode>
+struct ArenaHandlerPolicy
+{
+	template <typename Backing>
+	struct Engine
+	{
+		Engine()
+		{
+			handler.mode = allocation_mode;
+			handler.arena_backing = Backing::backing;
+		}
+
+		[[nodiscard]]
+		void* request_memory(const size_t size, const uint8_t alignment)
+		{
+			return handler.request_memory(size, alignment);
+		}
+
+		[[nodiscard]]
+		ErrorCode free_memory(void* ptr, const size_t size)
+		{
+			return handler.free_memory(ptr, size);
+		}
+
+		ArenaHandler handler;
+	};
+};
+
+using SegregatedFitPolicy = ArenaHandlerPolicy<AllocationMode::SegregatedFit>;
+using TlsfPolicy = ArenaHandlerPolicy<AllocationMode::Tlsf>;
+
+/**
+ * @brief Maps an arena of at least `size` bytes for a bump policy, writing its
+ * size to `mem_amount` and its backing to `backing`, or returns nullptr.
+ *
+ * Arenas start at `arena_size` and double up to `max_arena_size`, tracked in
+ * `next_arena_size`. Reserved backing maps with Mmap instead, as nothing would
+ * commit the arena.
+ **/
+[[nodiscard]]
+inline int8_t* map_bump_arena(const size_t size, const size_t arena_size,
+	const size_t max_arena_size, size_t& next_arena_size, size_t& mem_amount,
+	ArenaBacking& backing)
+{
+	mem_amount = next_arena_size < arena_size ? arena_size : next_arena_size;
+	if (mem_amount < size)
+	{
+		mem_amount = size;
+	}
+
+	if (backing == ArenaBacking::Reserved)
+	{
+		backing = ArenaBacking::Mmap;
+	}
+
+	int8_t* mem = allocate_arena_memory(mem_amount, backing);
+	if (mem == nullptr)
+	{
+		return nullptr;
+	}
+
+	next_arena_size = mem_amount > max_arena_size / 2 ? max_arena_size
+													  : mem_amount * 2;
+	return mem;
+}
+
+/**
+ * @brief Free list policy that only ever bumps a pointer through its arenas.
+ *
+ * Frees are no-ops, and memory comes back all at once through reset() or the
+ * destructor. Each arena starts with a BumpChunk linking it to the one before,
+ * and arenas grow geometrically like ArenaHandler's. Reserved backing maps
+ * arenas with Mmap instead, as nothing would commit them.
+ **/
+struct BumpPolicy
+{
+	struct BumpChunk
+	{
+		BumpChunk* prev = nullptr;
+		size_t size = 0;
+		ArenaBacking backing = ArenaBacking::Malloc;
+	};
+
+	template <typename Backing>
+	struct Engine
+	{
+		static_assert(Backing::backing != ArenaBacking::Upstream &&
+				Backing::backing != ArenaBacking::Seeded,
+			"BumpPolicy maps its own arenas.");
+
+		Engine() = default;
+		Engine(const Engine&) = delete;
+		Engine& operator=(const Engine&) = delete;
+
+		~Engine()
+		{
+			reset();
+		}
+
+		[[nodiscard]]
+		void* request_memory(const size_t size, const uint8_t alignment)
+		{
+			const uintptr_t align = alignment == 0 ? 1 : alignment;
+			uintptr_t addr = ((uintptr_t)untouched_mem + align - 1) & ~(align - 1);
+			if (chunk == nullptr || addr > (uintptr_t)end ||
+				(uintptr_t)end - addr < size)
+			{
+				if (!add_chunk(size + align))
+				{
+					return nullptr;
+				}
+
+				addr = ((uintptr_t)untouched_mem + align - 1) & ~(align - 1);
+			}
+
+			untouched_mem = (int8_t*)(addr + size);
+			return (void*)addr;
+		}
+
+		[[nodiscard]]
+		ErrorCode free_memory(void*, const size_t)
+		{
+			return ErrorCode::Success;
+		}
+
+		/**
+		 * @brief Releases every arena, invalidating all memory handed out.
+		 **/
+		void reset()
+		{
+			while (chunk != nullptr)
+			{
+				BumpChunk* prev = chunk->prev;
+				release_arena_memory((int8_t*)chunk, chunk->size, chunk->backing);
+				chunk = prev;
+			}
+
+			untouched_mem = nullptr;
+			end = nullptr;
+			next_arena_size = 0;
+		}
+
+		// Size of the first arena, doubled for each one after it up to
+		// `max_arena_size`.
+		size_t arena_size = DEFAULT_ARENA_SIZE;
+		size_t max_arena_size = DEFAULT_MAX_ARENA_SIZE;
+
+		// The arena being bumped, newest first, and its unused range.
+		BumpChunk* chunk = nullptr;
+		int8_t* untouched_mem = nullptr;
+		int8_t* end = nullptr;
+
+		// Size of the next arena, or 0 to start from `arena_size`.
+		size_t next_arena_size = 0;
+
+		/**
+		 * @brief Maps a new arena able to hold `size` bytes after its BumpChunk
+		 * and makes it the one being bumped. The old arena's tail is abandoned.
+		 **/
+		[[nodiscard]]
+		bool add_chunk(const size_t size)
+		{
+			if (size > SIZE_MAX - sizeof(BumpChunk))
+			{
+				return false;
+			}
+
+			size_t mem_amount = 0;
+			ArenaBacking backing = Backing::backing;
+			int8_t* mem = map_bump_arena(size + sizeof(BumpChunk), arena_size,
+				max_arena_size, next_arena_size, mem_amount, backing);
+			if (mem == nullptr)
+			{
+				return false;
+			}
+
+			BumpChunk* added = new (mem) BumpChunk();
+			added->prev = chunk;
+			added->size = mem_amount;
+			added->backing = backing;
+			chunk = added;
+			untouched_mem = mem + sizeof(BumpChunk);
+			end = mem + mem_amount;
+			return true;
+		}
+	};
+};
+
+/**
+ * @brief Free list policy like BumpPolicy whose requests may come from many
+ * threads at once without a lock.
+ *
+ * Each arena's untouched pointer is atomic and bumped with a compare-and-swap
+ * loop, so threads allocating from the same arena never wait on each other.
+ * Only installing a new arena takes `grow_lock`: a request that finds the
+ * arena exhausted rechecks under the lock, so one thread maps the next arena
+ * while the rest retry against it. Old arenas stay mapped until reset(), so a
+ * thread still bumping one that was just replaced only fails its fit and
+ * retries.
+ *
+ * Pair it with NoLock. reset() and the destructor must not race with requests.
+ **/
+struct AtomicBumpPolicy
+{
+	struct AtomicBumpChunk
+	{
+		AtomicBumpChunk* prev = nullptr;
+		size_t size = 0;
+		ArenaBacking backing = ArenaBacking::Malloc;
+		std::atomic<int8_t*> untouched_mem = nullptr;
+		int8_t* end = nullptr;
+	};
+
+	template <typename Backing>
+	struct Engine
+	{
+		static_assert(Backing::backing != ArenaBacking::Upstream &&
+				Backing::backing != ArenaBacking::Seeded,
+			"AtomicBumpPolicy maps its own arenas.");
+
+		Engine() = default;
+		Engine(const Engine&) = delete;
+		Engine& operator=(const Engine&) = delete;
+
+		~Engine()
+		{
+			reset();
+		}
+
+		[[nodiscard]]
+		void* request_memory(const size_t size, const uint8_t alignment)
+		{
+			const uintptr_t align = alignment == 0 ? 1 : alignment;
+			AtomicBumpChunk* current = chunk.load(std::memory_order_acquire);
+			while (true)
+			{
+				if (current != nullptr)
+				{
+					int8_t* untouched =
+						current->untouched_mem.load(std::memory_order_relaxed);
+					uintptr_t addr = ((uintptr_t)untouched + align - 1) & ~(align - 1);
+					while (addr <= (uintptr_t)current->end &&
+						(uintptr_t)current->end - addr >= size)
+					{
+						if (current->untouched_mem.compare_exchange_weak(untouched,
+								(int8_t*)(addr + size), std::memory_order_relaxed))
+						{
+							return (void*)addr;
+						}
+
+						addr = ((uintptr_t)untouched + align - 1) & ~(align - 1);
+					}
+				}
+
+				current = add_chunk(current, size + align);
+				if (current == nullptr)
+				{
+					return nullptr;
+				}
+			}
+		}
+
+		[[nodiscard]]
+		ErrorCode free_memory(void*, const size_t)
+		{
+			return ErrorCode::Success;
+		}
+
+		/**
+		 * @brief Releases every arena, invalidating all memory handed out.
+		 **/
+		void reset()
+		{
+			AtomicBumpChunk* current = chunk.load(std::memory_order_relaxed);
+			while (current != nullptr)
+			{
+				AtomicBumpChunk* prev = current->prev;
+				const size_t size = current->size;
+				const ArenaBacking backing = current->backing;
+				current->~AtomicBumpChunk();
+				release_arena_memory((int8_t*)current, size, backing);
+				current = prev;
+			}
+
+			chunk.store(nullptr, std::memory_order_relaxed);
+			next_arena_size = 0;
+		}
+
+		// Size of the first arena, doubled for each one after it up to
+		// `max_arena_size`. Only change before the first request.
+		size_t arena_size = DEFAULT_ARENA_SIZE;
+		size_t max_arena_size = DEFAULT_MAX_ARENA_SIZE;
+
+		// The arena being bumped, newest first.
+		std::atomic<AtomicBumpChunk*> chunk = nullptr;
+
+		// Held while installing a new arena, along with `next_arena_size`.
+		std::mutex grow_lock;
+		size_t next_arena_size = 0;
+
+		/**
+		 * @brief Installs a new arena able to hold `size` bytes after its
+		 * AtomicBumpChunk, unless another thread replaced `exhausted` first.
+		 * Returns the arena now being bumped, or nullptr if mapping failed.
+		 **/
+		[[nodiscard]]
+		AtomicBumpChunk* add_chunk(AtomicBumpChunk* exhausted, const size_t size)
+		{
+			if (size > SIZE_MAX - sizeof(AtomicBumpChunk))
+			{
+				return nullptr;
+			}
+
+			grow_lock.lock();
+			AtomicBumpChunk* current = chunk.load(std::memory_order_acquire);
+			if (current != exhausted)
+			{
+				grow_lock.unlock();
+				return current;
+			}
+
+			size_t mem_amount = 0;
+			ArenaBacking backing = Backing::backing;
+			int8_t* mem = map_bump_arena(size + sizeof(AtomicBumpChunk), arena_size,
+				max_arena_size, next_arena_size, mem_amount, backing);
+			if (mem == nullptr)
+			{
+				grow_lock.unlock();
+				return nullptr;
+			}
+
+			AtomicBumpChunk* added = new (mem) AtomicBumpChunk();
+			added->prev = current;
+			added->size = mem_amount;
+			added->backing = backing;
+			added->untouched_mem.store(
+				mem + sizeof(AtomicBumpChunk), std::memory_order_relaxed);
+			added->end = mem + mem_amount;
+			chunk.store(added, std::memory_order_release);
+			grow_lock.unlock();
+			return added;
+		}
+	};
+};
+
+/**
+ * @brief Lock policy for handlers used by a single thread.
+ **/
+struct NoLock
+{
+	void lock()
+	{
+	}
+
+	void unlock()
+	{
+	}
+};
+
+/**
+ * @brief Lock policy serialising every call on a std::mutex.
+ **/
+struct MutexLock
+{
+	void lock()
+	{
+		mutex.lock();
+	}
+
+	void unlock()
+	{
+		mutex.unlock();
+	}
+
+	std::mutex mutex;
+};
+
+/**
+ * @brief Stats policy that records nothing.
+ **/
+struct NoStats
+{
+	void on_request(const size_t, const bool)
+	{
+	}
+
+	void on_free(const size_t)
+	{
+	}
+};
+
+/**
+ * @brief Stats policy counting requests and frees, and the bytes they covered.
+ **/
+struct CountingStats
+{
+	void on_request(const size_t size, const bool succeeded)
+	{
+		if (succeeded)
+		{
+			requests++;
+			bytes_requested += size;
+		}
+
+		else
+		{
+			failed_requests++;
+		}
+	}
+
+	void on_free(const size_t size)
+	{
+		frees++;
+		bytes_freed += size;
+	}
+
+	size_t requests = 0;
+	size_t failed_requests = 0;
+	size_t frees = 0;
+	size_t bytes_requested = 0;
+	size_t bytes_freed = 0;
+};
+
+/**
+ * @brief Arena handler assembled from policies at compile time.
+ *
+ * Requests always use the default allocation, so there is no per-call branch
+ * on it. The policies' own state is reachable through `engine`, `lock` and
+ * `stats`.
+ **/
+template <typename FreeListPolicy = SegregatedFitPolicy,
+	typename Backing = MallocBacking, typename LockPolicy = NoLock,
+	typename StatsPolicy = NoStats>
+struct BasicArenaHandler
+{
+	using Engine = typename FreeListPolicy::template Engine<Backing>;
+
+	[[nodiscard]]
+	void* request_memory(const size_t size, const uint8_t alignment)
+	{
+		lock.lock();
+		void* ptr = engine.request_memory(size, alignment);
+		stats.on_request(size, ptr != nullptr);
+		lock.unlock();
+		return ptr;
+	}
+
+	[[nodiscard]]
+	ErrorCode free_memory(void* ptr, const size_t size)
+	{
+		lock.lock();
+		const ErrorCode result = engine.free_memory(ptr, size);
+		if (result == ErrorCode::Success)
+		{
+			stats.on_free(size);
+		}
+
+		lock.unlock();
+		return result;
+	}
+
+	// NoLock and NoStats take no space.
+	Engine engine;
+	[[no_unique_address]] LockPolicy lock;
+	[[no_unique_address]] StatsPolicy stats;
+};
+
+// Equivalent to a default constructed ArenaHandler.
+using DefaultArenaHandler = BasicArenaHandler<>;
+
+// A single threaded, never freeing bump allocator.
+using BumpArenaHandler = BasicArenaHandler<BumpPolicy>;
+
+// A never freeing bump allocator shared between threads without a lock.
+using AtomicBumpArenaHandler = BasicArenaHandler<AtomicBumpPolicy>;
+
+} // namespace mem_arena_handler
+
+#endif // BASIC_ARENA_HANDLER_HPP
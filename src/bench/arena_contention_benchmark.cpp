@@ -0,0 +1,167 @@
+// Throughput of request/free pairs from many threads sharing one handler,
+// comparing a single mutex around ArenaHandler with ConcurrentArenaHandler, on
+// its own and behind a ThreadCache per thread, and with ShardedArenaHandler.
+//
+// Usage: arena_contention_benchmark [pairs per thread] [max threads]
+//
+// Each thread keeps a window of small allocations live and replaces a random
+// one on every step, so requests are a mix of free block reuse and frontier
+// bumps. Thread counts double from 1 up to the maximum.
+//
+// A second table times bump-only requests for tiny nodes that are never freed,
+// comparing BumpPolicy behind a mutex with the lock-free AtomicBumpPolicy. Each
+// thread makes a sixteenth as many requests as it does pairs above, to bound
+// the memory held.
+
+#include "basic_arena_handler.hpp"
+#include "concurrent_arena_handler.hpp"
+#include "sharded_arena_handler.hpp"
+#include "thread_cache.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace mem_arena_handler;
+
+constexpr size_t WINDOW = 256;
+constexpr size_t MAX_THREADS = 256;
+
+using MutexArenaHandler =
+	BasicArenaHandler<SegregatedFitPolicy, MallocBacking, MutexLock>;
+using MutexBumpArenaHandler =
+	BasicArenaHandler<BumpPolicy, MallocBacking, MutexLock>;
+
+template <typename Handler>
+static void churn(Handler& handler, const size_t pairs, const uint64_t seed)
+{
+	void* ptrs[WINDOW] = {};
+	size_t sizes[WINDOW] = {};
+	uint64_t state = seed;
+	for (size_t ii = 0; ii < pairs; ii++)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		const size_t slot = state % WINDOW;
+		if (ptrs[slot] != nullptr &&
+			handler.free_memory(ptrs[slot], sizes[slot]) != ErrorCode::Success)
+		{
+			printf("free failed\n");
+			exit(1);
+		}
+
+		sizes[slot] = 16 * (1 + (state >> 32) % 16);
+		ptrs[slot] = handler.request_memory(sizes[slot], 8);
+		if (ptrs[slot] == nullptr)
+		{
+			printf("request failed\n");
+			exit(1);
+		}
+	}
+
+	for (size_t slot = 0; slot < WINDOW; slot++)
+	{
+		if (ptrs[slot] != nullptr)
+		{
+			(void)handler.free_memory(ptrs[slot], sizes[slot]);
+		}
+	}
+}
+
+template <typename Handler>
+static void bump_nodes(Handler& handler, const size_t requests, const uint64_t seed)
+{
+	uint64_t state = seed;
+	for (size_t ii = 0; ii < requests; ii++)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		if (handler.request_memory(16 + 8 * (state % 5), 8) == nullptr)
+		{
+			printf("request failed\n");
+			exit(1);
+		}
+	}
+}
+
+static void churn_cached(
+	ConcurrentArenaHandler& shared, const size_t pairs, const uint64_t seed)
+{
+	ThreadCache cache(shared);
+	churn(cache, pairs, seed);
+}
+
+/**
+ * @brief Runs `threads_len` threads of `worker` against one fresh handler and
+ * returns the steps, request/free pairs or requests, completed per microsecond.
+ **/
+template <typename Handler>
+static double run(void (*worker)(Handler&, const size_t, const uint64_t),
+	const size_t threads_len, const size_t pairs)
+{
+	Handler handler;
+	std::thread threads[MAX_THREADS];
+
+	const auto begin = std::chrono::steady_clock::now();
+	for (size_t tt = 0; tt < threads_len; tt++)
+	{
+		threads[tt] = std::thread(worker, std::ref(handler), pairs,
+			0x9e3779b97f4a7c15ull * (tt + 1));
+	}
+
+	for (size_t tt = 0; tt < threads_len; tt++)
+	{
+		threads[tt].join();
+	}
+
+	const double us =
+		(double)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - begin)
+			.count();
+	return (double)(threads_len * pairs) / us;
+}
+
+int main(int argc, char** argv)
+{
+	const size_t pairs = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+	size_t max_threads = argc > 2 ? strtoull(argv[2], nullptr, 10) : 64;
+	if (max_threads > MAX_THREADS)
+	{
+		max_threads = MAX_THREADS;
+	}
+
+	printf("%zu request/free pairs per thread, %u hardware threads\n", pairs,
+		std::thread::hardware_concurrency());
+	printf("threads   single mutex (pairs/us)   concurrent (pairs/us)   "
+		   "thread cache (pairs/us)   per-CPU shards (pairs/us)\n");
+	for (size_t threads_len = 1; threads_len <= max_threads; threads_len *= 2)
+	{
+		const double mutex =
+			run<MutexArenaHandler>(churn<MutexArenaHandler>, threads_len, pairs);
+		const double concurrent = run<ConcurrentArenaHandler>(
+			churn<ConcurrentArenaHandler>, threads_len, pairs);
+		const double cached =
+			run<ConcurrentArenaHandler>(churn_cached, threads_len, pairs);
+		const double sharded = run<ShardedArenaHandler>(
+			churn<ShardedArenaHandler>, threads_len, pairs);
+		printf("%7zu   %23.2f   %21.2f   %23.2f   %25.2f\n", threads_len, mutex,
+			concurrent, cached, sharded);
+	}
+
+	const size_t requests = pairs / 16;
+	printf("\n%zu bump-only requests per thread\n", requests);
+	printf("threads   mutex bump (requests/us)   atomic bump (requests/us)\n");
+	for (size_t threads_len = 1; threads_len <= max_threads; threads_len *= 2)
+	{
+		const double mutex = run<MutexBumpArenaHandler>(
+			bump_nodes<MutexBumpArenaHandler>, threads_len, requests);
+		const double atomic = run<AtomicBumpArenaHandler>(
+			bump_nodes<AtomicBumpArenaHandler>, threads_len, requests);
+		printf("%7zu   %24.2f   %25.2f\n", threads_len, mutex, atomic);
+	}
+
+	return 0;
+}
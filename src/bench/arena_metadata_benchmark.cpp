@@ -0,0 +1,98 @@
+// Cost of the handler's bookkeeping on the request/free hot path, and how many
+// arenas a handler can grow to.
+//
+// Usage: arena_metadata_benchmark [operations] [arenas]
+//
+// The churn loop keeps a window of small allocations live and frees them in a
+// scrambled order, so every call updates the arena and free block counters.
+// The growth loop then forces one arena per request until `arenas` exist or
+// the handler refuses.
+
+#include "memory_arena_handler.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace mem_arena_handler;
+
+constexpr size_t WINDOW = 4096;
+
+static double elapsed_ns(const std::chrono::steady_clock::time_point begin)
+{
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - begin)
+		.count();
+}
+
+static void run_churn(const size_t operations)
+{
+	ArenaHandler handler;
+	void* ptrs[WINDOW] = {};
+	size_t sizes[WINDOW] = {};
+	uint64_t state = 0x9e3779b97f4a7c15ull;
+
+	const auto begin = std::chrono::steady_clock::now();
+	for (size_t ii = 0; ii < operations; ii++)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		const size_t slot = state % WINDOW;
+		if (ptrs[slot] != nullptr)
+		{
+			if (handler.free_memory(ptrs[slot], sizes[slot]) != ErrorCode::Success)
+			{
+				printf("churn: free failed\n");
+				return;
+			}
+		}
+
+		sizes[slot] = 64;
+		ptrs[slot] = handler.request_memory(sizes[slot], 8);
+		if (ptrs[slot] == nullptr)
+		{
+			printf("churn: request failed\n");
+			return;
+		}
+	}
+
+	const double ns = elapsed_ns(begin);
+	printf("churn   %10zu request/free pairs  %8.2f ns/pair  (%zu free blocks)\n",
+		operations, ns / (double)operations, (size_t)handler.ds_info.free_blocks_len);
+}
+
+static void run_growth(const size_t arenas)
+{
+	ArenaHandler handler;
+	handler.arena_growth_factor = 1;
+	handler.request_growth_factor = 1;
+
+	const auto begin = std::chrono::steady_clock::now();
+	size_t created = 0;
+	while (created < arenas)
+	{
+		// Each request fills a fresh arena exactly.
+		if (handler.request_memory(4096, 8, false) == nullptr)
+		{
+			break;
+		}
+
+		created = handler.ds_info.arenas_len;
+	}
+
+	const double ns = elapsed_ns(begin);
+	printf("growth  %10zu arenas created%s  %8.2f ns/arena\n", created,
+		created < arenas ? " before failing" : "",
+		created == 0 ? 0.0 : ns / (double)created);
+}
+
+int main(int argc, char** argv)
+{
+	const size_t operations = argc > 1 ? strtoull(argv[1], nullptr, 10) : 20000000;
+	const size_t arenas = argc > 2 ? strtoull(argv[2], nullptr, 10) : 20000;
+
+	run_churn(operations);
+	run_growth(arenas);
+	return 0;
+}
@@ -0,0 +1,171 @@
+// Random reads over one large arena allocation, comparing arena backings.
+//
+// Usage: arena_tlb_benchmark [megabytes] [reads]
+//
+// On Linux, dTLB load misses are read from perf_event_open where the kernel
+// allows it; elsewhere only the time per read is reported.
+
+#include "memory_arena_handler.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace mem_arena_handler;
+
+/**
+ * @brief Counts dTLB read misses of the calling thread, if perf events are
+ * available.
+ **/
+struct TlbMissCounter
+{
+	TlbMissCounter()
+	{
+#ifdef __linux__
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+
+	~TlbMissCounter()
+	{
+#ifdef __linux__
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+#endif
+	}
+
+	void start()
+	{
+#ifdef __linux__
+		if (fd >= 0)
+		{
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	/**
+	 * @brief Returns the misses since start(), or -1 if they can't be counted.
+	 **/
+	long long stop()
+	{
+#ifdef __linux__
+		long long count = 0;
+		if (fd >= 0)
+		{
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(fd, &count, sizeof(count)) == sizeof(count))
+			{
+				return count;
+			}
+		}
+#endif
+		return -1;
+	}
+
+	int fd = -1;
+};
+
+static const char* backing_name(const ArenaBacking backing)
+{
+	switch (backing)
+	{
+	case ArenaBacking::Malloc:
+		return "malloc";
+	case ArenaBacking::Mmap:
+		return "mmap + THP";
+	case ArenaBacking::MmapHugeTlb:
+		return "MAP_HUGETLB";
+	case ArenaBacking::Reserved:
+		return "reserved";
+	case ArenaBacking::Upstream:
+		return "upstream";
+	case ArenaBacking::Seeded:
+		return "seeded";
+	}
+
+	return "unknown";
+}
+
+static void run(const ArenaBacking backing, const size_t size, const size_t reads)
+{
+	ArenaHandler handler;
+	handler.arena_backing = backing;
+
+	uint64_t* mem = (uint64_t*)handler.request_memory(size, 64, false);
+	if (mem == nullptr)
+	{
+		printf("%-12s  allocation failed\n", backing_name(backing));
+		return;
+	}
+
+	// Touch every page first, so page faults aren't part of the measurement.
+	const size_t words = size / sizeof(uint64_t);
+	for (size_t ii = 0; ii < words; ii++)
+	{
+		mem[ii] = ii;
+	}
+
+	TlbMissCounter counter;
+	uint64_t state = 0x9e3779b97f4a7c15ull;
+	uint64_t sum = 0;
+
+	counter.start();
+	const auto begin = std::chrono::steady_clock::now();
+	for (size_t ii = 0; ii < reads; ii++)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		sum += mem[state % words];
+	}
+
+	const auto end = std::chrono::steady_clock::now();
+	const long long misses = counter.stop();
+
+	const double ns =
+		(double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)
+			.count();
+	printf("%-12s  %8.2f ns/read", backing_name(handler.arenas[0].backing),
+		ns / (double)reads);
+	if (misses >= 0)
+	{
+		printf("  %10lld dTLB misses  (%.3f per read)", misses,
+			(double)misses / (double)reads);
+	}
+
+	printf("  [checksum %llu]\n", (unsigned long long)sum);
+}
+
+int main(int argc, char** argv)
+{
+	const size_t megabytes = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1024;
+	const size_t reads = argc > 2 ? strtoull(argv[2], nullptr, 10) : 20000000;
+	const size_t size = megabytes << 20;
+
+	printf("%zu MB arena, %zu random reads\n", megabytes, reads);
+	run(ArenaBacking::Malloc, size, reads);
+	run(ArenaBacking::Mmap, size, reads);
+	run(ArenaBacking::MmapHugeTlb, size, reads);
+	return 0;
+}
@@ -0,0 +1,162 @@
+#include "concurrent_arena_handler.hpp"
+
+namespace mem_arena_handler
+{
+
+ConcurrentArenaHandler::ConcurrentArenaHandler(const ArenaHandlerConfig& config)
+	: handler(config)
+{
+	handler.mode = AllocationMode::SegregatedFit;
+	handler.track_allocation_sizes = false;
+}
+
+[[nodiscard]]
+static inline uint8_t size_class_of(const size_t size)
+{
+	return (uint8_t)(63 - __builtin_clzll((uint64_t)size | 1));
+}
+
+/**
+ * @brief Records which size classes `handler` has free memory in. Call with
+ * `free_lock` held.
+ **/
+static inline void publish_free_classes(ConcurrentArenaHandler& concurrent)
+{
+	concurrent.free_classes.store(
+		concurrent.handler.size_class_bitmap | concurrent.handler.sliver_bitmap,
+		std::memory_order_relaxed);
+}
+
+/**
+ * @brief Frees the rest of the frontier chunk and leases a new one of at least
+ * `size` bytes. Call with `frontier_lock` held.
+ **/
+[[nodiscard]]
+static bool refill_frontier(ConcurrentArenaHandler& concurrent, const size_t size)
+{
+	size_t chunk_size = concurrent.frontier_chunk_size;
+	if (chunk_size < size)
+	{
+		chunk_size = round_to_quantum(size);
+	}
+
+	concurrent.free_lock.lock();
+	if (concurrent.frontier != concurrent.frontier_end)
+	{
+		(void)concurrent.handler.free_memory(
+			concurrent.frontier, concurrent.frontier_end - concurrent.frontier);
+	}
+
+	int8_t* chunk = (int8_t*)concurrent.handler.request_memory(
+		chunk_size, CONCURRENT_SIZE_QUANTUM);
+	publish_free_classes(concurrent);
+	concurrent.free_lock.unlock();
+
+	if (chunk == nullptr)
+	{
+		concurrent.frontier = nullptr;
+		concurrent.frontier_end = nullptr;
+		return false;
+	}
+
+	concurrent.frontier = chunk;
+	concurrent.frontier_end = chunk + chunk_size;
+	return true;
+}
+
+void* ConcurrentArenaHandler::request_free_memory(
+	const size_t size, const uint8_t alignment)
+{
+	const size_t rounded = round_to_quantum(size == 0 ? 1 : size);
+	if ((free_classes.load(std::memory_order_relaxed) >> size_class_of(rounded)) ==
+		0)
+	{
+		return nullptr;
+	}
+
+	free_lock.lock();
+	void* ptr = handler.request_free_memory(rounded, alignment);
+	publish_free_classes(*this);
+	free_lock.unlock();
+	return ptr;
+}
+
+void* ConcurrentArenaHandler::request_memory(
+	const size_t size, const uint8_t alignment)
+{
+	if (void* ptr = request_free_memory(size, alignment); ptr != nullptr)
+	{
+		return ptr;
+	}
+
+	const size_t rounded = round_to_quantum(size == 0 ? 1 : size);
+
+	// Large requests would strand most of a chunk, so they skip the frontier.
+	if (rounded > frontier_chunk_size / 4)
+	{
+		free_lock.lock();
+		void* ptr = handler.request_memory(rounded, alignment);
+		publish_free_classes(*this);
+		free_lock.unlock();
+		return ptr;
+	}
+
+	const uintptr_t align = alignment == 0 ? 1 : alignment;
+	frontier_lock.lock();
+	uintptr_t addr = ((uintptr_t)frontier + align - 1) & ~(align - 1);
+	if (frontier == nullptr || addr > (uintptr_t)frontier_end ||
+		(uintptr_t)frontier_end - addr < rounded)
+	{
+		if (!refill_frontier(*this, rounded + align))
+		{
+			frontier_lock.unlock();
+			return nullptr;
+		}
+
+		addr = ((uintptr_t)frontier + align - 1) & ~(align - 1);
+	}
+
+	int8_t* padding = frontier;
+	frontier = (int8_t*)(addr + rounded);
+	frontier_lock.unlock();
+
+	// Only alignments beyond the quantum leave padding, which goes back to the
+	// free blocks like any other freed memory.
+	if ((uintptr_t)padding != addr)
+	{
+		free_lock.lock();
+		(void)handler.free_memory(padding, addr - (uintptr_t)padding);
+		publish_free_classes(*this);
+		free_lock.unlock();
+	}
+
+	return (void*)addr;
+}
+
+ErrorCode ConcurrentArenaHandler::free_memory(void* ptr, const size_t size)
+{
+	const size_t rounded = round_to_quantum(size == 0 ? 1 : size);
+	free_lock.lock();
+	const ErrorCode result = handler.free_memory(ptr, rounded);
+	publish_free_classes(*this);
+	free_lock.unlock();
+	return result;
+}
+
+ErrorCode ConcurrentArenaHandler::free_memory_batch(
+	FreeRequest* requests, const size_t count)
+{
+	for (size_t ii = 0; ii < count; ii++)
+	{
+		const size_t size = requests[ii].size;
+		requests[ii].size = round_to_quantum(size == 0 ? 1 : size);
+	}
+
+	free_lock.lock();
+	const ErrorCode result = handler.free_memory_batch(requests, count);
+	publish_free_classes(*this);
+	free_lock.unlock();
+	return result;
+}
+
+} // namespace mem_arena_handler
@@ -0,0 +1,95 @@
+#ifndef CONCURRENT_ARENA_HANDLER_HPP
+#define CONCURRENT_ARENA_HANDLER_HPP
+
+#include "memory_arena_handler.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+
+namespace mem_arena_handler
+{
+
+constexpr size_t DEFAULT_FRONTIER_CHUNK_SIZE = 1 << 16;
+
+// Sizes are rounded up to a multiple of this on request and free, so the
+// frontier stays aligned to it without padding.
+constexpr size_t CONCURRENT_SIZE_QUANTUM = 16;
+
+[[nodiscard]]
+inline size_t round_to_quantum(const size_t size)
+{
+	return (size + CONCURRENT_SIZE_QUANTUM - 1) & ~(CONCURRENT_SIZE_QUANTUM - 1);
+}
+
+/**
+ * @brief An ArenaHandler that may be shared between threads.
+ *
+ * Free memory and the arena frontier have separate locks. Requests try the free
+ * blocks under `free_lock`, skipping it entirely when no size class could fit,
+ * and otherwise bump the frontier chunk under `frontier_lock` alone. Frees only
+ * take `free_lock`. The frontier leases its chunks from `handler` as ordinary
+ * allocations and frees their tails back when it moves on, so every byte stays
+ * accounted for in the arena it came from.
+ *
+ * Always runs in segregated-fit mode without allocation headers, so sizes must
+ * be passed to free_memory.
+ **/
+struct ConcurrentArenaHandler
+{
+	ConcurrentArenaHandler() = default;
+
+	/**
+	 * @brief Builds a handler tuned by `config`, apart from its mode and size
+	 * tracking.
+	 **/
+	explicit ConcurrentArenaHandler(const ArenaHandlerConfig& config);
+
+	[[nodiscard]]
+	void* request_memory(const size_t size, const uint8_t alignment);
+
+	/**
+	 * @brief Serves a request from free memory only, neither bumping the
+	 * frontier nor creating an arena. Returns nullptr on a miss.
+	 **/
+	[[nodiscard]]
+	void* request_free_memory(const size_t size, const uint8_t alignment);
+
+	/**
+	 * @brief Frees `ptr`, or returns InvalidArgument if it doesn't lie in one of
+	 * the handler's arenas.
+	 **/
+	[[nodiscard]]
+	ErrorCode free_memory(void* ptr, const size_t size);
+
+	/**
+	 * @brief Frees `count` allocations under a single acquisition of
+	 * `free_lock`, merging adjacent ones as ArenaHandler::free_memory_batch does.
+	 * `requests` is reordered and its sizes rounded in place.
+	 **/
+	[[nodiscard]]
+	ErrorCode free_memory_batch(FreeRequest* requests, const size_t count);
+
+	// Arenas, free blocks and slivers. Only touch with `free_lock` held.
+	ArenaHandler handler;
+	std::mutex free_lock;
+
+	// Size classes holding free blocks or slivers in `handler`, republished after
+	// every change so requests can tell without the lock that nothing would fit.
+	std::atomic<uint64_t> free_classes = 0;
+
+	// The unused part of the chunk being bumped. Only touch with `frontier_lock`
+	// held; `free_lock` may be taken inside it, never the other way round.
+	std::mutex frontier_lock;
+	int8_t* frontier = nullptr;
+	int8_t* frontier_end = nullptr;
+
+	// Size of each chunk leased for the frontier. Requests larger than a quarter
+	// of it go straight to `handler`.
+	size_t frontier_chunk_size = DEFAULT_FRONTIER_CHUNK_SIZE;
+};
+
+} // namespace mem_arena_handler
+
+#endif // CONCURRENT_ARENA_HANDLER_HPP
@@ -1,352 +1,2300 @@
 #include "memory_arena_handler.hpp"
+#include "arena_memory.hpp"
+#include "tlsf.hpp"
 
+#include <chrono>
 #include <cstdio>
 #include <cstring>
+#include <new>
 
 namespace mem_arena_handler
 {
 
-constexpr uint16_t ARENAS_MAX_CAPACITY = (1 << ARENA_DS_BITS) - 1;
-constexpr size_t DEFAULT_MEMORY_ARENA_ALLOCATION = 1 << 20;
-constexpr uint32_t FREE_BLOCKS_MAX_CAPACITY = (1 << FREE_BLOCKS_DS_BITS) - 1;
-constexpr uint8_t INITIAL_MEMORY_ARENAS_CAPACITY = 3;
-constexpr uint8_t INITIAL_FREE_BLOCKS_CAPACITY = 50;
-constexpr uint32_t MIN_FREE_BLOCK_SIZE = 256;
+// Bounded by the width of FreeBlock::arena_index. The value itself is never a
+// valid index, so it doubles as "no arena".
+constexpr uint32_t ARENAS_MAX_CAPACITY = (1u << 31) - 1;
 
 MemoryArena::~MemoryArena()
 {
-	free(mem_block);
+	release_arena_memory(mem_block, size, backing);
+}
+
+ArenaHandler::ArenaHandler(const ArenaHandlerConfig& config)
+{
+	arena_size = config.arena_size == 0 ? 1 : config.arena_size;
+	request_growth_factor =
+		config.request_growth_factor == 0 ? 1 : config.request_growth_factor;
+	arena_growth_factor =
+		config.arena_growth_factor == 0 ? 1 : config.arena_growth_factor;
+	max_arena_size = config.max_arena_size;
+	initial_arenas_capacity = config.initial_arenas_capacity;
+	if (initial_arenas_capacity == 0)
+	{
+		initial_arenas_capacity = 1;
+	}
+
+	else if (initial_arenas_capacity > ARENAS_MAX_CAPACITY)
+	{
+		initial_arenas_capacity = ARENAS_MAX_CAPACITY;
+	}
+
+	// Remainders are only kept if they hold their own record anyway.
+	min_free_block_size = config.min_free_block_size < sizeof(FreeBlock) ?
+		sizeof(FreeBlock) : config.min_free_block_size;
+	arena_retire_threshold = config.arena_retire_threshold;
+	purge_threshold = config.purge_threshold;
+	retained_free_arenas = config.retained_free_arenas;
+	arena_decay_ms = config.arena_decay_ms;
+	arena_backing = config.arena_backing;
+	upstream = config.upstream;
+	reservation_size = config.reservation_size;
+	mode = config.mode;
+	track_allocation_sizes = config.track_allocation_sizes;
 }
 
 ArenaHandler::~ArenaHandler()
 {
-	for (uint16_t ii = 0; ii < ds_info.arenas_len; ii++)
+	for (uint32_t ii = 0; ii < ds_info.arenas_len; ii++)
+	{
+		if (arenas[ii].backing == ArenaBacking::Upstream &&
+			arenas[ii].mem_block != nullptr && upstream.release != nullptr)
+		{
+			upstream.release(arenas[ii].mem_block, arenas[ii].size, upstream.user_data);
+		}
+
+		arenas[ii].~MemoryArena();
+	}
+
+	free(arenas);
+	free(arena_order);
+	free(arena_space);
+	tlsf_destroy_control(tlsf);
+}
+
+/**
+ * @brief Returns how many bytes of arena `arena_index` are still untouched.
+ **/
+[[nodiscard]]
+static inline size_t arena_remaining(
+	const ArenaHandler& handler, const uint32_t arena_index)
+{
+	const MemoryArena& arena = handler.arenas[arena_index];
+	return arena.mem_block + arena.size - arena.untouched_mem;
+}
+
+/**
+ * @brief Sets the leaf of arena `arena_index` in the arena space tree to its
+ * untouched bytes, then updates the maxima above it.
+ **/
+static inline void update_arena_space(
+	ArenaHandler& handler, const uint32_t arena_index)
+{
+	size_t node = handler.arena_space_leaves + arena_index;
+	handler.arena_space[node] = arena_remaining(handler, arena_index);
+	for (node /= 2; node > 0; node /= 2)
+	{
+		const size_t left = handler.arena_space[2 * node];
+		const size_t right = handler.arena_space[2 * node + 1];
+		handler.arena_space[node] = left > right ? left : right;
+	}
+}
+
+/**
+ * @brief Grows the arena space tree to hold at least `capacity` leaves, rebuilding
+ * it from the arenas.
+ **/
+[[nodiscard]]
+static bool resize_arena_space(ArenaHandler& handler, const uint32_t capacity)
+{
+	uint32_t leaves = 1;
+	while (leaves < capacity)
+	{
+		leaves *= 2;
+	}
+
+	if (leaves == handler.arena_space_leaves)
+	{
+		return true;
+	}
+
+	size_t* tree = (size_t*)calloc(2 * (size_t)leaves, sizeof(size_t));
+	if (tree == nullptr)
+	{
+		return false;
+	}
+
+	free(handler.arena_space);
+	handler.arena_space = tree;
+	handler.arena_space_leaves = leaves;
+	for (uint32_t ii = 0; ii < handler.ds_info.arenas_len; ii++)
+	{
+		update_arena_space(handler, ii);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Returns the first arena the tree records as having at least `size`
+ * untouched bytes, or ARENAS_MAX_CAPACITY if there is none.
+ *
+ * Leaves are only refreshed when an arena is created, retired or found wanting,
+ * so they may overstate what is left, but never understate it.
+ **/
+[[nodiscard]]
+static inline uint32_t find_arena_space(const ArenaHandler& handler, const size_t size)
+{
+	if (handler.arena_space == nullptr || handler.arena_space[1] < size)
+	{
+		return ARENAS_MAX_CAPACITY;
+	}
+
+	size_t node = 1;
+	while (node < handler.arena_space_leaves)
+	{
+		node = handler.arena_space[2 * node] >= size ? 2 * node : 2 * node + 1;
+	}
+
+	return (uint32_t)(node - handler.arena_space_leaves);
+}
+
+/**
+ * @brief Returns whether the tree records arena `arena_index` as having at least
+ * `size` untouched bytes.
+ **/
+[[nodiscard]]
+static inline bool arena_space_fits(
+	const ArenaHandler& handler, const uint32_t arena_index, const size_t size)
+{
+	return handler.arena_space[handler.arena_space_leaves + arena_index] >= size;
+}
+
+static inline ErrorCode resize_arenas(ArenaHandler& handler)
+{
+	if (handler.ds_info.arenas_capacity == ARENAS_MAX_CAPACITY)
+	{
+		return ErrorCode::InsufficientResource;
+	}
+
+	if (handler.arenas == nullptr)
+	{
+		const uint32_t capacity = handler.initial_arenas_capacity;
+		handler.arenas = (MemoryArena*)malloc(sizeof(MemoryArena) * capacity);
+		handler.arena_order = (uint32_t*)malloc(sizeof(uint32_t) * capacity);
+		if (handler.arenas == nullptr || handler.arena_order == nullptr ||
+			!resize_arena_space(handler, capacity))
+		{
+			free(handler.arenas);
+			free(handler.arena_order);
+			handler.arenas = nullptr;
+			handler.arena_order = nullptr;
+			return ErrorCode::OutOfMemory;
+		}
+
+		handler.ds_info.arenas_capacity = capacity;
+		return ErrorCode::Success;
+	}
+
+	const uint32_t new_capacity =
+		handler.ds_info.arenas_capacity > ARENAS_MAX_CAPACITY / 2
+		? ARENAS_MAX_CAPACITY
+		: handler.ds_info.arenas_capacity * 2;
+
+	MemoryArena* mem =
+		(MemoryArena*)realloc(handler.arenas, sizeof(MemoryArena) * new_capacity);
+	if (mem == nullptr)
+	{
+		return ErrorCode::OutOfMemory;
+	}
+
+	handler.arenas = mem;
+
+	uint32_t* order =
+		(uint32_t*)realloc(handler.arena_order, sizeof(uint32_t) * new_capacity);
+	if (order == nullptr)
+	{
+		return ErrorCode::OutOfMemory;
+	}
+
+	handler.arena_order = order;
+	if (!resize_arena_space(handler, new_capacity))
+	{
+		return ErrorCode::OutOfMemory;
+	}
+
+	handler.ds_info.arenas_capacity = new_capacity;
+	return ErrorCode::Success;
+}
+
+/**
+ * @brief Returns the index of the arena whose memory block contains `ptr`.
+ *
+ * `ptr` must lie inside one of the handler's arenas; check with owns() first
+ * where it comes from the caller.
+ **/
+[[nodiscard]]
+static inline uint32_t find_arena(const ArenaHandler& handler, const void* ptr)
+{
+	uint32_t low = 0;
+	uint32_t high = handler.ds_info.arenas_len - handler.released_arenas_len;
+	while (high - low > 1)
+	{
+		const uint32_t mid = (low + high) / 2;
+		if ((uintptr_t)handler.arenas[handler.arena_order[mid]].mem_block <=
+			(uintptr_t)ptr)
+		{
+			low = mid;
+		}
+
+		else
+		{
+			high = mid;
+		}
+	}
+
+	return handler.arena_order[low];
+}
+
+/**
+ * @brief Adds arena `index` to `arena_order`, keeping it sorted by address.
+ **/
+static inline void insert_arena_order(ArenaHandler& handler, const uint32_t index)
+{
+	const uintptr_t mem_block = (uintptr_t)handler.arenas[index].mem_block;
+
+	uint32_t ii = handler.ds_info.arenas_len - handler.released_arenas_len;
+	while (ii > 0 &&
+		(uintptr_t)handler.arenas[handler.arena_order[ii - 1]].mem_block > mem_block)
+	{
+		handler.arena_order[ii] = handler.arena_order[ii - 1];
+		ii--;
+	}
+
+	handler.arena_order[ii] = index;
+}
+
+/**
+ * @brief Simply aligns `ptr` to the first aligned address, based on `alignment`,
+ * greater than itself.
+ **/
+[[nodiscard]]
+static inline void* align_forward(void* ptr, const uint8_t alignment)
+{
+	return (void*)(((uintptr_t)ptr + (uintptr_t)alignment - 1) &
+		~((uintptr_t)alignment - 1));
+}
+
+/**
+ * @brief Header written directly before each allocation when
+ * ArenaHandler::track_allocation_sizes is set.
+ *
+ * The allocation owns [ptr - offset, ptr + usable_size), which includes any
+ * alignment padding in front of the header.
+ **/
+struct AllocationHeader
+{
+	uint64_t usable_size : 56;
+	uint64_t offset : 8;
+};
+
+static_assert(sizeof(AllocationHeader) == 8, "AllocationHeader must stay compact.");
+
+[[nodiscard]]
+static inline AllocationHeader* allocation_header(void* ptr)
+{
+	return (AllocationHeader*)ptr - 1;
+}
+
+/**
+ * @brief Returns the aligned pointer handed out for a region starting at `start`,
+ * leaving `header_size` bytes in front of it.
+ **/
+[[nodiscard]]
+static inline void* align_allocation(
+	void* start, const uint8_t header_size, const uint8_t alignment)
+{
+	return align_forward((int8_t*)start + header_size, alignment);
+}
+
+/**
+ * @brief Records the region [start, end) in the header in front of `ptr`, if
+ * headers are in use.
+ **/
+static inline void write_allocation_header(const uint8_t header_size, void* ptr,
+	const uintptr_t start, const uintptr_t end)
+{
+	if (header_size == 0)
+	{
+		return;
+	}
+
+	AllocationHeader* header = allocation_header(ptr);
+	header->usable_size = end - (uintptr_t)ptr;
+	header->offset = (uintptr_t)ptr - start;
+}
+
+/**
+ * @brief Returns where the record for the free region [ptr, ptr + size) lives,
+ * or nullptr if the region is too small to hold one.
+ *
+ * Records sit at the end of their region, so carving memory off the front of a
+ * free block never has to move them.
+ **/
+[[nodiscard]]
+static inline FreeBlock* free_block_record(void* ptr, const size_t size)
+{
+	if (size < sizeof(FreeBlock))
+	{
+		return nullptr;
+	}
+
+	const uintptr_t record = ((uintptr_t)ptr + size - sizeof(FreeBlock)) &
+		~(uintptr_t)(alignof(FreeBlock) - 1);
+	return record < (uintptr_t)ptr ? nullptr : (FreeBlock*)record;
+}
+
+/**
+ * @brief Returns whether the free region [ptr, ptr + size) is kept as a free
+ * block: it must reach the handler's threshold and still hold its own record.
+ **/
+[[nodiscard]]
+static inline bool keeps_free_block(
+	const ArenaHandler& handler, void* ptr, const size_t size)
+{
+	return size >= handler.min_free_block_size &&
+		free_block_record(ptr, size) != nullptr;
+}
+
+/**
+ * @brief Returns the power-of-two size class of `size`, i.e. floor(log2(size)).
+ **/
+[[nodiscard]]
+static inline uint8_t size_class_of(const size_t size)
+{
+	return (uint8_t)(63 - __builtin_clzll((uint64_t)size | 1));
+}
+
+static inline void link_size_class(ArenaHandler& handler, FreeBlock* block)
+{
+	const uint8_t size_class = size_class_of(block->size);
+	FreeBlock* head = handler.size_class_heads[size_class];
+
+	block->prev_in_class = nullptr;
+	block->next_in_class = head;
+	if (head != nullptr)
+	{
+		head->prev_in_class = block;
+	}
+
+	handler.size_class_heads[size_class] = block;
+	handler.size_class_bitmap |= 1ull << size_class;
+}
+
+static inline void unlink_size_class(ArenaHandler& handler, FreeBlock* block)
+{
+	const uint8_t size_class = size_class_of(block->size);
+	if (block->prev_in_class != nullptr)
+	{
+		block->prev_in_class->next_in_class = block->next_in_class;
+	}
+
+	else
+	{
+		handler.size_class_heads[size_class] = block->next_in_class;
+	}
+
+	if (block->next_in_class != nullptr)
+	{
+		block->next_in_class->prev_in_class = block->prev_in_class;
+	}
+
+	if (handler.size_class_heads[size_class] == nullptr)
+	{
+		handler.size_class_bitmap &= ~(1ull << size_class);
+	}
+}
+
+/**
+ * @brief Updates a free block's range, moving it to its new size class if needed.
+ *
+ * The new range must keep the block between the same neighbours and still
+ * contain its record, so its place in the address treap is unaffected.
+ **/
+static inline void update_free_block(
+	ArenaHandler& handler, FreeBlock* block, void* ptr, const size_t size)
+{
+	const bool same_class = size_class_of(block->size) == size_class_of(size);
+	if (!same_class)
+	{
+		unlink_size_class(handler, block);
+	}
+
+	block->ptr = ptr;
+	block->size = size;
+	if (!same_class)
+	{
+		link_size_class(handler, block);
+	}
+}
+
+/**
+ * @brief Derives a treap priority from a block's address.
+ *
+ * Hashing the address spreads priorities well enough to keep the expected depth
+ * logarithmic, without keeping random number state in the handler.
+ **/
+[[nodiscard]]
+static inline uint32_t treap_priority(void* ptr)
+{
+	uint64_t hash = (uint64_t)(uintptr_t)ptr;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	return (uint32_t)hash;
+}
+
+/**
+ * @brief Returns the treap root of the arena `block` lies in.
+ **/
+[[nodiscard]]
+static inline FreeBlock*& treap_root(ArenaHandler& handler, const FreeBlock* block)
+{
+	return handler.arenas[block->arena_index].free_block_root;
+}
+
+/**
+ * @brief Returns the link (root or child pointer) that refers to `block`.
+ **/
+[[nodiscard]]
+static inline FreeBlock** find_treap_link(FreeBlock*& root, FreeBlock* block)
+{
+	FreeBlock** link = &root;
+	while (*link != block)
+	{
+		link = (uintptr_t)block->ptr < (uintptr_t)(*link)->ptr ? &(*link)->left
+															   : &(*link)->right;
+	}
+
+	return link;
+}
+
+/**
+ * @brief Inserts `block` into the address treap.
+ *
+ * The block descends until its priority outranks the subtree below, which is
+ * then split around its address into the block's two children.
+ **/
+static inline void insert_treap(FreeBlock*& root, FreeBlock* block)
+{
+	block->priority = treap_priority(block->ptr);
+
+	FreeBlock** link = &root;
+	while (*link != nullptr && (*link)->priority >= block->priority)
+	{
+		link = (uintptr_t)block->ptr < (uintptr_t)(*link)->ptr ? &(*link)->left
+															   : &(*link)->right;
+	}
+
+	FreeBlock* current = *link;
+	FreeBlock** left = &block->left;
+	FreeBlock** right = &block->right;
+	while (current != nullptr)
+	{
+		if ((uintptr_t)current->ptr < (uintptr_t)block->ptr)
+		{
+			*left = current;
+			left = &current->right;
+			current = current->right;
+		}
+
+		else
+		{
+			*right = current;
+			right = &current->left;
+			current = current->left;
+		}
+	}
+
+	*left = nullptr;
+	*right = nullptr;
+	*link = block;
+}
+
+/**
+ * @brief Detaches `block` from the address treap by merging its children in its
+ * place.
+ **/
+static inline void erase_treap(FreeBlock*& root, FreeBlock* block)
+{
+	FreeBlock** link = find_treap_link(root, block);
+	FreeBlock* left = block->left;
+	FreeBlock* right = block->right;
+	while (left != nullptr && right != nullptr)
+	{
+		if (left->priority > right->priority)
+		{
+			*link = left;
+			link = &left->right;
+			left = left->right;
+		}
+
+		else
+		{
+			*link = right;
+			link = &right->left;
+			right = right->left;
+		}
+	}
+
+	*link = left != nullptr ? left : right;
+}
+
+/**
+ * @brief Finds the free blocks directly before and at-or-after `ptr` in address
+ * order, setting either to nullptr if there is none.
+ **/
+static inline void find_treap_neighbours(FreeBlock* root, void* ptr,
+	FreeBlock*& left_block, FreeBlock*& right_block)
+{
+	left_block = nullptr;
+	right_block = nullptr;
+
+	FreeBlock* current = root;
+	while (current != nullptr)
+	{
+		if ((uintptr_t)current->ptr < (uintptr_t)ptr)
+		{
+			left_block = current;
+			current = current->right;
+		}
+
+		else
+		{
+			right_block = current;
+			current = current->left;
+		}
+	}
+}
+
+/**
+ * @brief Starts tracking the free region [ptr, ptr + size) in arena
+ * `arena_index`. The region must not touch any existing free block.
+ *
+ * Returns false if the region is too small to hold its own record.
+ **/
+static inline bool insert_free_block(ArenaHandler& handler,
+	const uint32_t arena_index, void* ptr, const size_t size)
+{
+	FreeBlock* block = free_block_record(ptr, size);
+	if (block == nullptr)
+	{
+		return false;
+	}
+
+	block->ptr = ptr;
+	block->size = size;
+	block->arena_index = arena_index;
+	block->purged = false;
+	link_size_class(handler, block);
+	insert_treap(handler.arenas[arena_index].free_block_root, block);
+	handler.ds_info.free_blocks_len++;
+	return true;
+}
+
+static inline void remove_free_block(ArenaHandler& handler, FreeBlock* block)
+{
+	unlink_size_class(handler, block);
+	erase_treap(treap_root(handler, block), block);
+	handler.ds_info.free_blocks_len--;
+}
+
+/**
+ * @brief Grows `block` to end at `end`, moving its record to the new end of the
+ * region.
+ **/
+static inline void extend_free_block(
+	ArenaHandler& handler, FreeBlock* block, const uintptr_t end)
+{
+	void* ptr = block->ptr;
+	const size_t size = end - (uintptr_t)ptr;
+	FreeBlock* moved = free_block_record(ptr, size);
+
+	unlink_size_class(handler, block);
+	FreeBlock** link = find_treap_link(treap_root(handler, block), block);
+	memmove((void*)moved, (void*)block, sizeof(FreeBlock));
+	*link = moved;
+
+	moved->size = size;
+	moved->purged = false;
+	link_size_class(handler, moved);
+}
+
+/**
+ * @brief Returns where the record for the sliver [ptr, ptr + size) lives, or
+ * nullptr if the region is too small to hold one.
+ **/
+[[nodiscard]]
+static inline SliverBlock* sliver_record(void* ptr, const size_t size)
+{
+	if (size < sizeof(SliverBlock))
+	{
+		return nullptr;
+	}
+
+	const uintptr_t record = ((uintptr_t)ptr + size - sizeof(SliverBlock)) &
+		~(uintptr_t)(alignof(SliverBlock) - 1);
+	return record < (uintptr_t)ptr ? nullptr : (SliverBlock*)record;
+}
+
+/**
+ * @brief Pushes the region [ptr, ptr + size) onto its sliver bin.
+ *
+ * Returns false if the region is too small to hold a SliverBlock record, in which
+ * case it is counted as dropped.
+ **/
+static inline bool bin_sliver(ArenaHandler& handler, void* ptr, const size_t size)
+{
+	SliverBlock* sliver = sliver_record(ptr, size);
+	if (sliver == nullptr)
+	{
+		handler.stats.dropped_bytes += size;
+		return false;
+	}
+
+	const uint8_t size_class = size_class_of(size);
+	sliver->ptr = ptr;
+	sliver->size = size;
+	sliver->next = handler.sliver_heads[size_class];
+	handler.sliver_heads[size_class] = sliver;
+	handler.sliver_bitmap |= 1ull << size_class;
+	handler.stats.sliver_bytes += size;
+	return true;
+}
+
+/**
+ * @brief Merges the region [ptr, ptr + size) into any free blocks of arena
+ * `arena_index` touching it.
+ *
+ * Returns false, leaving everything untouched, if neither neighbour is free.
+ **/
+static bool merge_with_neighbours(ArenaHandler& handler,
+	const uint32_t arena_index, void* ptr, const size_t size)
+{
+	// Find the blocks surrounding ptr, keeping them only if they touch it.
+	FreeBlock* left_block;
+	FreeBlock* right_block;
+	find_treap_neighbours(
+		handler.arenas[arena_index].free_block_root, ptr, left_block, right_block);
+	if (left_block != nullptr &&
+		(uintptr_t)left_block->ptr + left_block->size != (uintptr_t)ptr)
+	{
+		left_block = nullptr;
+	}
+
+	if (right_block != nullptr && (uintptr_t)ptr + size != (uintptr_t)right_block->ptr)
+	{
+		right_block = nullptr;
+	}
+
+	// Case 1: -- Merge [left .. new .. right] into single block.
+	//
+	// The right block's record already sits at the end of the merged block.
+	if (left_block != nullptr && right_block != nullptr)
+	{
+		void* merged_ptr = left_block->ptr;
+		const size_t merged_size = left_block->size + size + right_block->size;
+		remove_free_block(handler, left_block);
+		update_free_block(handler, right_block, merged_ptr, merged_size);
+		right_block->purged = false;
+		return true;
+	}
+
+	// Case 2: -- Merge [left .. new] into single block.
+	if (left_block != nullptr)
+	{
+		extend_free_block(handler, left_block, (uintptr_t)ptr + size);
+		return true;
+	}
+
+	// Case 3: -- Merge [new .. right] into single block.
+	if (right_block != nullptr)
+	{
+		update_free_block(handler, right_block, ptr, right_block->size + size);
+		right_block->purged = false;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Returns the region [ptr, ptr + size) of arena `arena_index` to the free
+ * blocks, coalescing it with any free neighbours in the same arena.
+ *
+ * Isolated regions too small to hold a FreeBlock record go to the sliver bins.
+ * Returns false if the region was dropped for being too small even for those.
+ **/
+static bool free_region(ArenaHandler& handler, const uint32_t arena_index,
+	void* ptr, const size_t size)
+{
+	// Case 4: Place new block in the arena's free blocks treap.
+	return merge_with_neighbours(handler, arena_index, ptr, size) ||
+		insert_free_block(handler, arena_index, ptr, size) ||
+		bin_sliver(handler, ptr, size);
+}
+
+/**
+ * @brief Returns the alignment padding [start, end) skipped in front of an
+ * allocation to the free blocks or sliver bins, or counts it as lost if it is too
+ * small for either.
+ **/
+static inline void reclaim_padding(ArenaHandler& handler,
+	const uint32_t arena_index, const uintptr_t start, const uintptr_t end)
+{
+	if (start == end)
+	{
+		return;
+	}
+
+	if (free_region(handler, arena_index, (void*)start, end - start))
+	{
+		handler.stats.padding_bytes_reclaimed += end - start;
+	}
+
+	else
+	{
+		handler.stats.padding_bytes_lost += end - start;
+	}
+}
+
+static inline void pop_sliver(ArenaHandler& handler, const uint8_t size_class)
+{
+	SliverBlock* sliver = handler.sliver_heads[size_class];
+	handler.sliver_heads[size_class] = sliver->next;
+	if (sliver->next == nullptr)
+	{
+		handler.sliver_bitmap &= ~(1ull << size_class);
+	}
+
+	handler.stats.sliver_bytes -= sliver->size;
+}
+
+/**
+ * @brief Sorts a list of slivers by address with a bottom-up merge sort.
+ **/
+[[nodiscard]]
+static SliverBlock* sort_slivers(SliverBlock* list)
+{
+	for (size_t run = 1;; run *= 2)
+	{
+		SliverBlock* sorted = nullptr;
+		SliverBlock** tail = &sorted;
+		size_t merges = 0;
+
+		while (list != nullptr)
+		{
+			merges++;
+
+			// Split off two runs of up to `run` slivers each.
+			SliverBlock* left = list;
+			SliverBlock* right = list;
+			size_t left_len = 0;
+			while (right != nullptr && left_len < run)
+			{
+				right = right->next;
+				left_len++;
+			}
+
+			size_t right_len = 0;
+			list = right;
+			while (list != nullptr && right_len < run)
+			{
+				list = list->next;
+				right_len++;
+			}
+
+			while (left_len > 0 || right_len > 0)
+			{
+				SliverBlock** take;
+				if (right_len == 0 ||
+					(left_len > 0 && (uintptr_t)left->ptr < (uintptr_t)right->ptr))
+				{
+					take = &left;
+					left_len--;
+				}
+
+				else
+				{
+					take = &right;
+					right_len--;
+				}
+
+				*tail = *take;
+				tail = &(*take)->next;
+				*take = (*take)->next;
+			}
+		}
+
+		*tail = nullptr;
+		if (merges <= 1)
+		{
+			return sorted;
+		}
+
+		list = sorted;
+	}
+}
+
+/**
+ * @brief Re-merges slivers with each other and with the free blocks they touch.
+ *
+ * Slivers aren't kept in address order, so this runs lazily, once a request
+ * would otherwise need a new arena. Merged regions that reach the handler's
+ * `min_free_block_size` join the free blocks; the rest go back to their bins.
+ * Slivers in different arenas are never merged, even if their memory touches.
+ **/
+static void consolidate_slivers(ArenaHandler& handler)
+{
+	SliverBlock* list = nullptr;
+	while (handler.sliver_bitmap != 0)
+	{
+		const uint8_t size_class = (uint8_t)__builtin_ctzll(handler.sliver_bitmap);
+		SliverBlock* sliver = handler.sliver_heads[size_class];
+		pop_sliver(handler, size_class);
+		sliver->next = list;
+		list = sliver;
+	}
+
+	list = sort_slivers(list);
+	while (list != nullptr)
+	{
+		// Records sit inside the slivers, so read each before it is overwritten.
+		void* ptr = list->ptr;
+		size_t size = list->size;
+		list = list->next;
+
+		const uint32_t arena_index = find_arena(handler, ptr);
+		const MemoryArena& arena = handler.arenas[arena_index];
+		const uintptr_t arena_end = (uintptr_t)arena.mem_block + arena.size;
+		while (list != nullptr && (uintptr_t)ptr + size == (uintptr_t)list->ptr &&
+			(uintptr_t)list->ptr != arena_end)
+		{
+			size += list->size;
+			list = list->next;
+		}
+
+		if (merge_with_neighbours(handler, arena_index, ptr, size))
+		{
+			continue;
+		}
+
+		if (!keeps_free_block(handler, ptr, size) ||
+			!insert_free_block(handler, arena_index, ptr, size))
+		{
+			(void)bin_sliver(handler, ptr, size);
+		}
+	}
+}
+
+/**
+ * @brief Takes a sliver able to hold `size` bytes at `alignment` behind a
+ * `header_size` byte header, or returns nullptr.
+ *
+ * As with free blocks, bins above the worst case's class always fit. Otherwise
+ * only the heads of the boundary bins are tried, keeping this constant time.
+ **/
+[[nodiscard]]
+static inline void* check_slivers(ArenaHandler& handler, const size_t size,
+	const uint8_t alignment, const uint8_t header_size)
+{
+	if (handler.sliver_bitmap == 0)
+	{
+		return nullptr;
+	}
+
+	const uint8_t worst_class = size_class_of(header_size + size + alignment - 1);
+	uint8_t size_class = FREE_BLOCK_SIZE_CLASSES;
+	if (worst_class < FREE_BLOCK_SIZE_CLASSES - 1)
+	{
+		const uint64_t larger_classes =
+			handler.sliver_bitmap & (~0ull << (worst_class + 1));
+		if (larger_classes != 0)
+		{
+			size_class = (uint8_t)__builtin_ctzll(larger_classes);
+		}
+	}
+
+	for (uint8_t ii = size_class_of(header_size + size);
+		size_class == FREE_BLOCK_SIZE_CLASSES && ii <= worst_class; ii++)
+	{
+		const SliverBlock* sliver = handler.sliver_heads[ii];
+		if (sliver != nullptr &&
+			(uintptr_t)align_allocation(sliver->ptr, header_size, alignment) + size <=
+				(uintptr_t)sliver->ptr + sliver->size)
+		{
+			size_class = ii;
+		}
+	}
+
+	if (size_class == FREE_BLOCK_SIZE_CLASSES)
+	{
+		return nullptr;
+	}
+
+	SliverBlock* sliver = handler.sliver_heads[size_class];
+	const uintptr_t start_addr = (uintptr_t)sliver->ptr;
+	const uintptr_t end_addr = start_addr + sliver->size;
+	pop_sliver(handler, size_class);
+
+	void* aligned_ptr = align_allocation((void*)start_addr, header_size, alignment);
+	const uintptr_t needed_end_addr = (uintptr_t)aligned_ptr + size;
+	const uint32_t arena_index = find_arena(handler, (void*)start_addr);
+	MemoryArena& arena = handler.arenas[arena_index];
+
+	// Headers let the whole sliver go to the allocation. Otherwise the padding
+	// and what's left over go back to the bins.
+	if (header_size != 0)
+	{
+		write_allocation_header(header_size, aligned_ptr, start_addr, end_addr);
+		arena.live_bytes += end_addr - start_addr;
+		return aligned_ptr;
+	}
+
+	if (needed_end_addr != end_addr)
+	{
+		(void)bin_sliver(handler, (void*)needed_end_addr, end_addr - needed_end_addr);
+	}
+
+	arena.live_bytes += size;
+	reclaim_padding(handler, arena_index, start_addr, (uintptr_t)aligned_ptr);
+	return aligned_ptr;
+}
+
+/**
+ * @brief Returns a free block able to hold `size` bytes at `alignment` behind a
+ * `header_size` byte header, or nullptr.
+ *
+ * Any block in a size class above that of the worst case (`header_size + size +
+ * alignment - 1`) fits no matter how its pointer is aligned, so the bitmap finds
+ * one in constant time. Only when no such class is populated are the few boundary
+ * classes scanned first-fit, up to FIT_SCAN_LIMIT blocks each, so a miss costs
+ * the same however many free blocks there are and the request falls through to
+ * the arenas.
+ **/
+[[nodiscard]]
+static inline FreeBlock* find_fitting_block(const ArenaHandler& handler,
+	const size_t size, const uint8_t alignment, const uint8_t header_size)
+{
+	const uint8_t worst_class = size_class_of(header_size + size + alignment - 1);
+	if (worst_class < FREE_BLOCK_SIZE_CLASSES - 1)
+	{
+		const uint64_t larger_classes =
+			handler.size_class_bitmap & (~0ull << (worst_class + 1));
+		if (larger_classes != 0)
+		{
+			return handler.size_class_heads[__builtin_ctzll(larger_classes)];
+		}
+	}
+
+	for (uint8_t size_class = size_class_of(header_size + size);
+		size_class <= worst_class; size_class++)
+	{
+		uint32_t scanned = 0;
+		for (FreeBlock* free_block = handler.size_class_heads[size_class];
+			free_block != nullptr && scanned < FIT_SCAN_LIMIT;
+			free_block = free_block->next_in_class, scanned++)
+		{
+			const uintptr_t needed_end_addr =
+				(uintptr_t)align_allocation(free_block->ptr, header_size, alignment) +
+				size;
+			if (needed_end_addr <= (uintptr_t)free_block->ptr + free_block->size)
+			{
+				return free_block;
+			}
+		}
+	}
+
+	return nullptr;
+}
+
+[[nodiscard]]
+static inline void* check_free_blocks(ArenaHandler& handler, const size_t size,
+	const uint8_t alignment, const uint8_t header_size)
+{
+	if (handler.size_class_bitmap == 0)
+	{
+		return nullptr;
+	}
+
+	FreeBlock* free_block =
+		find_fitting_block(handler, size, alignment, header_size);
+	if (free_block == nullptr)
+	{
+		return nullptr;
+	}
+
+	// Align the free block's pointer and calculate the needed end address for the
+	// requested block.
+	const uintptr_t start_addr = (uintptr_t)free_block->ptr;
+	void* aligned_ptr = align_allocation(free_block->ptr, header_size, alignment);
+	const uintptr_t needed_end_addr = (uintptr_t)aligned_ptr + size;
+	const uintptr_t actual_end_addr = start_addr + free_block->size;
+	const uint32_t arena_index = (uint32_t)free_block->arena_index;
+	MemoryArena& arena = handler.arenas[arena_index];
+
+	// The remaining size in the block may be unnecessary to keep stored,
+	// bloating the number of free blocks.
+	//
+	// If it's under the handler's threshold or can't hold its own record, remove
+	// the block. A header can record the remainder as part of the allocation;
+	// otherwise it goes to the sliver bins, which serve small requests without
+	// touching the free blocks.
+	if (!keeps_free_block(
+			handler, (void*)needed_end_addr, actual_end_addr - needed_end_addr))
+	{
+		remove_free_block(handler, free_block);
+		if (header_size != 0)
+		{
+			write_allocation_header(
+				header_size, aligned_ptr, start_addr, actual_end_addr);
+			arena.live_bytes += actual_end_addr - start_addr;
+		}
+
+		else
+		{
+			if (needed_end_addr != actual_end_addr)
+			{
+				(void)bin_sliver(handler, (void*)needed_end_addr,
+					actual_end_addr - needed_end_addr);
+			}
+
+			arena.live_bytes += size;
+		}
+	}
+
+	// Otherwise, just update the free block's info. The record sits at the end of
+	// the block, well clear of the memory handed out.
+	else
+	{
+		update_free_block(handler, free_block, (void*)needed_end_addr,
+			actual_end_addr - needed_end_addr);
+		write_allocation_header(
+			header_size, aligned_ptr, start_addr, needed_end_addr);
+		arena.live_bytes += header_size != 0 ? needed_end_addr - start_addr : size;
+	}
+
+	// Headers already account for the padding in front of them.
+	if (header_size == 0)
+	{
+		reclaim_padding(handler, arena_index, start_addr, (uintptr_t)aligned_ptr);
+	}
+
+	return aligned_ptr;
+}
+
+/**
+ * @brief Hands whatever untouched memory arena `arena_index` has left to the free
+ * blocks, so the bump path never considers it again.
+ **/
+static inline void retire_arena(ArenaHandler& handler, const uint32_t arena_index)
+{
+	MemoryArena& arena = handler.arenas[arena_index];
+	int8_t* untouched_mem = arena.untouched_mem;
+	arena.untouched_mem = arena.mem_block + arena.size;
+	update_arena_space(handler, arena_index);
+
+	// Only committed memory can hold free block records.
+	if (arena.committed_end > untouched_mem)
+	{
+		(void)free_region(handler, arena_index, untouched_mem,
+			arena.committed_end - untouched_mem);
+	}
+}
+
+/**
+ * @brief Brings the arena space tree up to date for arena `arena_index`, retiring
+ * the arena if it has less than `arena_retire_threshold` bytes left.
+ **/
+static inline void refresh_arena_space(
+	ArenaHandler& handler, const uint32_t arena_index)
+{
+	if (arena_remaining(handler, arena_index) < handler.arena_retire_threshold)
+	{
+		retire_arena(handler, arena_index);
+	}
+
+	else
+	{
+		update_arena_space(handler, arena_index);
+	}
+}
+
+/**
+ * @brief Makes sure arena memory up to `end` is committed, committing it in
+ * ARENA_COMMIT_GRANULARITY steps as needed.
+ *
+ * Returns false if the memory couldn't be committed.
+ **/
+[[nodiscard]]
+static inline bool commit_arena(MemoryArena& arena, const uintptr_t end)
+{
+	if (end <= (uintptr_t)arena.committed_end)
+	{
+		return true;
+	}
+
+	const uintptr_t arena_end = (uintptr_t)arena.mem_block + arena.size;
+	uintptr_t commit_end =
+		(end + ARENA_COMMIT_GRANULARITY - 1) & ~(uintptr_t)(ARENA_COMMIT_GRANULARITY - 1);
+	if (commit_end > arena_end)
+	{
+		commit_end = arena_end;
+	}
+
+	if (!commit_arena_memory(
+			arena.committed_end, commit_end - (uintptr_t)arena.committed_end))
+	{
+		return false;
+	}
+
+	arena.committed_end = (int8_t*)commit_end;
+	return true;
+}
+
+/**
+ * @brief Carves a block from the untouched memory of arena `arena_index`, or
+ * returns nullptr if it doesn't fit.
+ **/
+[[nodiscard]]
+static inline void* bump_arena(ArenaHandler& handler, const uint32_t arena_index,
+	const size_t size, const uint8_t alignment, const uint8_t header_size)
+{
+	MemoryArena& arena = handler.arenas[arena_index];
+
+	// Align the arena's untouched pointer.
+	void* aligned_ptr = align_allocation(arena.untouched_mem, header_size, alignment);
+
+	// Calculate the needed end address and the actual end address of the arena.
+	const uintptr_t needed_end_addr = (uintptr_t)aligned_ptr + size;
+	const uintptr_t actual_end_addr = (uintptr_t)arena.mem_block + arena.size;
+	if (needed_end_addr > actual_end_addr || !commit_arena(arena, needed_end_addr))
+	{
+		return nullptr;
+	}
+
+	// Update the arena's info if data is used.
+	const uintptr_t start_addr = (uintptr_t)arena.untouched_mem;
+	write_allocation_header(header_size, aligned_ptr, start_addr, needed_end_addr);
+	arena.untouched_mem = (int8_t*)needed_end_addr;
+	arena.live_bytes += header_size != 0 ? needed_end_addr - start_addr : size;
+	if (header_size == 0)
+	{
+		reclaim_padding(handler, arena_index, start_addr, (uintptr_t)aligned_ptr);
+	}
+
+	return aligned_ptr;
+}
+
+/**
+ * @brief Carves a block from the untouched memory of the arenas, or returns
+ * nullptr if none has room.
+ *
+ * The current arena is tried first, so the common case touches a single arena.
+ * On a miss, the arena space tree finds an arena whose untouched memory fits the
+ * worst case in O(log arenas), and the arena holding the most is tried as a last
+ * resort.
+ **/
+[[nodiscard]]
+static void* check_arenas(ArenaHandler& handler, const size_t size,
+	const uint8_t alignment, const uint8_t header_size)
+{
+	if (handler.ds_info.arenas_len == 0)
+	{
+		return nullptr;
+	}
+
+	if (void* ptr =
+			bump_arena(handler, handler.current_arena, size, alignment, header_size);
+		ptr != nullptr)
+	{
+		return ptr;
+	}
+
+	refresh_arena_space(handler, handler.current_arena);
+
+	// Each miss refreshes a stale leaf, so this ends after at most one try per
+	// arena.
+	const size_t worst_size = header_size + size + alignment - 1;
+	for (uint32_t arena_index = find_arena_space(handler, worst_size);
+		arena_index != ARENAS_MAX_CAPACITY;
+		arena_index = find_arena_space(handler, worst_size))
+	{
+		if (void* ptr = bump_arena(handler, arena_index, size, alignment, header_size);
+			ptr != nullptr)
+		{
+			handler.current_arena = arena_index;
+			update_arena_space(handler, arena_index);
+			return ptr;
+		}
+
+		// An up to date leaf that still fits means the memory couldn't be
+		// committed, and would be found again.
+		refresh_arena_space(handler, arena_index);
+		if (arena_space_fits(handler, arena_index, worst_size))
+		{
+			return nullptr;
+		}
+	}
+
+	// Some arena may still fit the request, depending on its alignment.
+	const size_t best_size = header_size + size;
+	for (uint32_t arena_index = find_arena_space(handler, handler.arena_space[1]);
+		arena_index != ARENAS_MAX_CAPACITY && handler.arena_space[1] >= best_size;
+		arena_index = find_arena_space(handler, handler.arena_space[1]))
+	{
+		if (handler.arena_space[handler.arena_space_leaves + arena_index] ==
+			arena_remaining(handler, arena_index))
+		{
+			void* ptr = bump_arena(handler, arena_index, size, alignment, header_size);
+			if (ptr != nullptr)
+			{
+				handler.current_arena = arena_index;
+				update_arena_space(handler, arena_index);
+			}
+
+			return ptr;
+		}
+
+		refresh_arena_space(handler, arena_index);
+	}
+
+	return nullptr;
+}
+
+/**
+ * @brief Returns the default allocation for the next arena, grown once per arena
+ * held and capped at `max_arena_size`, though never below `arena_size`.
+ **/
+[[nodiscard]]
+static inline size_t default_arena_size(const ArenaHandler& handler)
+{
+	size_t arena_size = handler.arena_size;
+	const size_t factor = handler.arena_growth_factor;
+	const uint32_t held =
+		handler.ds_info.arenas_len - handler.released_arenas_len;
+	for (uint32_t ii = 0;
+		 ii < held && factor > 1 && arena_size < handler.max_arena_size; ii++)
+	{
+		arena_size = arena_size > handler.max_arena_size / factor
+			? handler.max_arena_size
+			: arena_size * factor;
+	}
+
+	return arena_size;
+}
+
+/**
+ * @brief Finds a slot for a new arena in `index`, reusing the slot of a released
+ * arena before growing the array. Returns false after reporting why there is
+ * none.
+ **/
+[[nodiscard]]
+static bool claim_arena_slot(ArenaHandler& handler, uint32_t& index)
+{
+	index = handler.ds_info.arenas_len;
+	if (handler.released_arenas_len != 0)
+	{
+		for (index = 0; handler.arenas[index].mem_block != nullptr; index++)
+		{
+		}
+	}
+
+	else if (handler.ds_info.arenas_len == handler.ds_info.arenas_capacity)
+	{
+		const ErrorCode result = resize_arenas(handler);
+		if (result == ErrorCode::OutOfMemory)
+		{
+			fprintf(stderr, "OOM error occurred in ArenaHandler.\n");
+			return false;
+		}
+
+		else if (result == ErrorCode::InsufficientResource)
+		{
+			fprintf(
+				stderr, "Max number of memory arenas created for ArenaHandler.\n");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief Sets up slot `index` as an arena over [mem, mem + size) and makes it the
+ * current arena.
+ **/
+static MemoryArena* install_arena(ArenaHandler& handler, const uint32_t index,
+	int8_t* mem, const size_t size, const ArenaBacking backing)
+{
+	MemoryArena& arena = *new (&handler.arenas[index]) MemoryArena();
+	arena.backing = backing;
+	arena.mem_block = mem;
+	arena.size = size;
+	arena.untouched_mem = arena.mem_block;
+	arena.committed_end = arena.backing == ArenaBacking::Reserved
+		? arena.mem_block
+		: arena.mem_block + arena.size;
+	insert_arena_order(handler, index);
+	if (handler.observer.installed != nullptr)
+	{
+		handler.observer.installed(mem, size, handler.observer.user_data);
+	}
+
+	if (index == handler.ds_info.arenas_len)
+	{
+		handler.ds_info.arenas_len++;
+	}
+
+	else
+	{
+		handler.released_arenas_len--;
+	}
+
+	// The newest arena has the most untouched memory, so the bump path tries it
+	// first from now on.
+	handler.current_arena = index;
+	update_arena_space(handler, index);
+	return &arena;
+}
+
+/**
+ * @brief Creates a new arena able to hold at least `size` bytes, or returns nullptr
+ * after reporting why it couldn't. A seeded handler fails quietly.
+ **/
+[[nodiscard]]
+static MemoryArena* create_arena(
+	ArenaHandler& handler, const size_t size, const bool use_default_allocation)
+{
+	// A seeded handler only ever uses the blocks it was given. Running out is
+	// expected, e.g. for a shard whose requests then overflow elsewhere, so it is
+	// left to the caller to report.
+	ArenaBacking backing = handler.arena_backing;
+	if (backing == ArenaBacking::Seeded)
+	{
+		return nullptr;
+	}
+
+	if (backing == ArenaBacking::Upstream && handler.upstream.acquire == nullptr)
+	{
+		fprintf(stderr, "No upstream allocator set for ArenaHandler.\n");
+		return nullptr;
+	}
+
+	// A reservation is the handler's only arena.
+	if (backing == ArenaBacking::Reserved)
+	{
+		if (handler.mode == AllocationMode::Tlsf)
+		{
+			backing = ArenaBacking::Mmap;
+		}
+
+		else if (handler.ds_info.arenas_len != 0)
+		{
+			fprintf(stderr, "Memory reservation exhausted for ArenaHandler.\n");
+			return nullptr;
+		}
+	}
+
+	uint32_t index = 0;
+	if (!claim_arena_slot(handler, index))
+	{
+		return nullptr;
+	}
+
+	// Given the purpose of memory arenas is performance, allocate more than
+	// requested.
+	//
+	// If the requested amount is smaller than the default allocation (and the
+	// default allocation is desired), use the default allocation amount.
+	size_t mem_amount = size > SIZE_MAX / handler.request_growth_factor
+		? size
+		: size * handler.request_growth_factor;
+	if (use_default_allocation)
+	{
+		const size_t default_amount = default_arena_size(handler);
+		if (mem_amount < default_amount)
+		{
+			mem_amount = default_amount;
+		}
+	}
+
+	if (backing == ArenaBacking::Reserved)
+	{
+		mem_amount = handler.reservation_size;
+	}
+
+	int8_t* mem = backing == ArenaBacking::Upstream
+		? (int8_t*)handler.upstream.acquire(mem_amount, handler.upstream.user_data)
+		: allocate_arena_memory(mem_amount, backing);
+	if (mem == nullptr)
+	{
+		fprintf(stderr, "Failed to allocate memory in new memory arena.\n");
+		return nullptr;
+	}
+
+	return install_arena(handler, index, mem, mem_amount, backing);
+}
+
+[[nodiscard]]
+static inline uint64_t now_ms()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+
+/**
+ * @brief Stops tracking every free block in the treap rooted at `block`.
+ **/
+static void forget_free_blocks(ArenaHandler& handler, FreeBlock* block)
+{
+	while (block != nullptr)
+	{
+		forget_free_blocks(handler, block->left);
+		unlink_size_class(handler, block);
+		handler.ds_info.free_blocks_len--;
+		block = block->right;
+	}
+}
+
+/**
+ * @brief Stops tracking every sliver starting inside [start, end).
+ **/
+static void forget_slivers(
+	ArenaHandler& handler, const uintptr_t start, const uintptr_t end)
+{
+	uint64_t bitmap = handler.sliver_bitmap;
+	while (bitmap != 0)
+	{
+		const uint8_t size_class = (uint8_t)__builtin_ctzll(bitmap);
+		bitmap &= bitmap - 1;
+
+		SliverBlock** link = &handler.sliver_heads[size_class];
+		while (*link != nullptr)
+		{
+			SliverBlock* sliver = *link;
+			if ((uintptr_t)sliver->ptr >= start && (uintptr_t)sliver->ptr < end)
+			{
+				*link = sliver->next;
+				handler.stats.sliver_bytes -= sliver->size;
+			}
+
+			else
+			{
+				link = &sliver->next;
+			}
+		}
+
+		if (handler.sliver_heads[size_class] == nullptr)
+		{
+			handler.sliver_bitmap &= ~(1ull << size_class);
+		}
+	}
+}
+
+/**
+ * @brief Gives the memory of fully free arena `arena_index` back to the system.
+ *
+ * Reserved arenas are decommitted and stay in place. Any other arena's slot is
+ * emptied for the next new arena to reuse.
+ **/
+static void release_arena(ArenaHandler& handler, const uint32_t arena_index)
+{
+	MemoryArena& arena = handler.arenas[arena_index];
+	forget_free_blocks(handler, arena.free_block_root);
+	arena.free_block_root = nullptr;
+	forget_slivers(handler, (uintptr_t)arena.mem_block,
+		(uintptr_t)arena.mem_block + arena.size);
+	if (handler.mode == AllocationMode::Tlsf)
+	{
+		tlsf_remove_pool(handler.tlsf, arena.mem_block);
+	}
+
+	handler.stats.arenas_released++;
+	if (arena.backing == ArenaBacking::Reserved)
+	{
+		const size_t committed = arena.committed_end - arena.mem_block;
+		decommit_arena_memory(arena.mem_block, committed);
+		handler.stats.bytes_released += committed;
+		arena.untouched_mem = arena.mem_block;
+		arena.committed_end = arena.mem_block;
+		update_arena_space(handler, arena_index);
+		return;
+	}
+
+	handler.stats.bytes_released += arena.size;
+
+	const uint32_t order_len =
+		handler.ds_info.arenas_len - handler.released_arenas_len;
+	uint32_t ii = 0;
+	while (handler.arena_order[ii] != arena_index)
+	{
+		ii++;
+	}
+
+	memmove(&handler.arena_order[ii], &handler.arena_order[ii + 1],
+		sizeof(uint32_t) * (order_len - ii - 1));
+
+	if (handler.observer.released != nullptr)
+	{
+		handler.observer.released(
+			arena.mem_block, arena.size, handler.observer.user_data);
+	}
+
+	if (arena.backing == ArenaBacking::Upstream)
+	{
+		handler.upstream.release(
+			arena.mem_block, arena.size, handler.upstream.user_data);
+	}
+
+	arena.~MemoryArena();
+	new (&arena) MemoryArena();
+	handler.released_arenas_len++;
+	update_arena_space(handler, arena_index);
+	if (handler.current_arena == arena_index && order_len > 1)
+	{
+		handler.current_arena = handler.arena_order[0];
+	}
+}
+
+/**
+ * @brief Releases fully free arenas beyond the `retained` most recently freed,
+ * oldest first, once they have been free for at least `decay_ms`.
+ *
+ * Returns the number of bytes released.
+ **/
+static size_t release_free_arenas(
+	ArenaHandler& handler, const uint32_t retained, const uint32_t decay_ms)
+{
+	const uint64_t now = decay_ms != 0 ? now_ms() : 0;
+	const size_t bytes_released = handler.stats.bytes_released;
+	while (true)
+	{
+		// Released slots and decommitted reservations have nothing committed.
+		// Seed blocks are never given back, and upstream arenas only when there
+		// is somewhere to give them.
+		uint32_t free_arenas_len = 0;
+		uint32_t oldest = ARENAS_MAX_CAPACITY;
+		for (uint32_t ii = 0; ii < handler.ds_info.arenas_len; ii++)
+		{
+			const MemoryArena& arena = handler.arenas[ii];
+			if (arena.live_bytes != 0 || arena.committed_end == arena.mem_block ||
+				arena.backing == ArenaBacking::Seeded ||
+				(arena.backing == ArenaBacking::Upstream &&
+					handler.upstream.release == nullptr))
+			{
+				continue;
+			}
+
+			free_arenas_len++;
+			if (oldest == ARENAS_MAX_CAPACITY ||
+				arena.free_since_ms < handler.arenas[oldest].free_since_ms)
+			{
+				oldest = ii;
+			}
+		}
+
+		if (free_arenas_len <= retained)
+		{
+			handler.release_due_ms = 0;
+			break;
+		}
+
+		if (decay_ms != 0 && now - handler.arenas[oldest].free_since_ms < decay_ms)
+		{
+			handler.release_due_ms = handler.arenas[oldest].free_since_ms + decay_ms;
+			break;
+		}
+
+		release_arena(handler, oldest);
+	}
+
+	return handler.stats.bytes_released - bytes_released;
+}
+
+[[nodiscard]]
+static void* tlsf_request_from_arenas(ArenaHandler& handler, const size_t size,
+	const uint8_t alignment, const bool use_default_allocation)
+{
+	if (handler.tlsf == nullptr)
+	{
+		handler.tlsf = tlsf_create_control();
+		if (handler.tlsf == nullptr)
+		{
+			fprintf(stderr, "OOM error occurred in ArenaHandler.\n");
+			return nullptr;
+		}
+	}
+
+	if (void* ptr = tlsf_request_memory(handler.tlsf, size, alignment);
+		ptr != nullptr)
+	{
+		handler.arenas[find_arena(handler, ptr)].live_bytes += tlsf_block_size(ptr);
+		return ptr;
+	}
+
+	// TLSF frees leave emptied arenas alone to keep their latency bounded, so
+	// release them here, on the slow path, before mapping another one.
+	(void)release_free_arenas(
+		handler, handler.retained_free_arenas, handler.arena_decay_ms);
+
+	// No pool has a fitting block, so hand TLSF an entire new arena.
+	MemoryArena* arena = create_arena(handler,
+		size + tlsf_pool_overhead(size, alignment), use_default_allocation);
+	if (arena == nullptr)
+	{
+		return nullptr;
+	}
+
+	if (!tlsf_add_pool(handler.tlsf, arena->mem_block, arena->size))
+	{
+		fprintf(stderr, "Memory arena too large for TLSF in ArenaHandler.\n");
+		return nullptr;
+	}
+
+	arena->untouched_mem = arena->mem_block + arena->size;
+	update_arena_space(handler, (uint32_t)(arena - handler.arenas));
+	void* ptr = tlsf_request_memory(handler.tlsf, size, alignment);
+	if (ptr != nullptr)
+	{
+		arena->live_bytes += tlsf_block_size(ptr);
+	}
+
+	return ptr;
+}
+
+/**
+ * @brief Sets the header size and the alignment to carve allocations at, given
+ * the caller's alignment in `header_alignment`.
+ **/
+static inline void header_layout(
+	const ArenaHandler& handler, uint8_t& header_size, uint8_t& header_alignment)
+{
+	// Headers are read and written in place, so keep them naturally aligned.
+	if (handler.track_allocation_sizes)
 	{
-		arenas[ii].~MemoryArena();
+		header_size = sizeof(AllocationHeader);
+		if (header_alignment < alignof(AllocationHeader))
+		{
+			header_alignment = alignof(AllocationHeader);
+		}
 	}
-
-	free(arenas);
-	free(free_blocks);
 }
 
-static inline ErrorCode resize_arenas(ArenaHandler& handler)
+void* ArenaHandler::request_memory(const size_t size, const uint8_t alignment,
+	const bool use_default_allocation /* = true */)
 {
-	if (handler.ds_info.arenas_capacity == ARENAS_MAX_CAPACITY)
+	if (mode == AllocationMode::Tlsf)
 	{
-		return ErrorCode::InsufficientResource;
+		return tlsf_request_from_arenas(
+			*this, size, alignment, use_default_allocation);
 	}
 
-	if (handler.arenas == nullptr)
+	uint8_t header_size = 0;
+	uint8_t header_alignment = alignment;
+	header_layout(*this, header_size, header_alignment);
+
+	// Small requests first try the sliver bins, then any free blocks.
+	if (void* ptr = check_slivers(*this, size, header_alignment, header_size);
+		ptr != nullptr)
+	{
+		return ptr;
+	}
+
+	if (void* ptr = check_free_blocks(*this, size, header_alignment, header_size);
+		ptr != nullptr)
+	{
+		return ptr;
+	}
+
+	if (void* ptr = check_arenas(*this, size, header_alignment, header_size);
+		ptr != nullptr)
+	{
+		return ptr;
+	}
+
+	// Before growing, give slivers whose neighbours have since been freed a chance
+	// to merge into something large enough.
+	if (sliver_bitmap != 0)
 	{
-		handler.arenas = (MemoryArena*)malloc(
-			sizeof(MemoryArena) * INITIAL_MEMORY_ARENAS_CAPACITY);
-		if (handler.arenas == nullptr)
+		consolidate_slivers(*this);
+		if (void* ptr = check_free_blocks(*this, size, header_alignment, header_size);
+			ptr != nullptr)
 		{
-			return ErrorCode::OutOfMemory;
+			return ptr;
 		}
-
-		handler.ds_info.arenas_capacity = INITIAL_MEMORY_ARENAS_CAPACITY;
-		return ErrorCode::Success;
 	}
 
-	uint16_t new_capacity = handler.ds_info.arenas_capacity * 2;
-	if (new_capacity < handler.ds_info.arenas_capacity)
+	// A new memory arena is needed at this point. Headers need room for
+	// themselves and the padding that aligns them.
+	size_t arena_request = size;
+	if (header_size != 0)
 	{
-		new_capacity = ARENAS_MAX_CAPACITY;
+		arena_request += header_size + header_alignment;
 	}
 
-	MemoryArena* mem =
-		(MemoryArena*)realloc(handler.arenas, sizeof(MemoryArena) * new_capacity);
-	if (mem == nullptr)
+	MemoryArena* arena = create_arena(*this, arena_request, use_default_allocation);
+	if (arena == nullptr)
 	{
-		return ErrorCode::OutOfMemory;
+		return nullptr;
 	}
 
-	handler.arenas = mem;
-	handler.ds_info.arenas_capacity = new_capacity;
-	return ErrorCode::Success;
+	return bump_arena(
+		*this, (uint32_t)(arena - arenas), size, header_alignment, header_size);
 }
 
-static inline ErrorCode resize_free_blocks(ArenaHandler& handler)
+void* ArenaHandler::request_free_memory(const size_t size, const uint8_t alignment)
 {
-	if (handler.ds_info.free_blocks_capacity == FREE_BLOCKS_MAX_CAPACITY)
+	if (mode == AllocationMode::Tlsf)
 	{
-		return ErrorCode::InsufficientResource;
+		return nullptr;
 	}
 
-	if (handler.free_blocks == nullptr)
+	uint8_t header_size = 0;
+	uint8_t header_alignment = alignment;
+	header_layout(*this, header_size, header_alignment);
+	if (void* ptr = check_slivers(*this, size, header_alignment, header_size);
+		ptr != nullptr)
 	{
-		handler.free_blocks =
-			(FreeBlock*)malloc(sizeof(FreeBlock) * INITIAL_FREE_BLOCKS_CAPACITY);
-		if (handler.free_blocks == nullptr)
-		{
-			return ErrorCode::OutOfMemory;
-		}
-
-		handler.ds_info.free_blocks_capacity = INITIAL_FREE_BLOCKS_CAPACITY;
-		return ErrorCode::Success;
+		return ptr;
 	}
 
-	uint32_t new_capacity = handler.ds_info.free_blocks_capacity * 2;
-	if (new_capacity < handler.ds_info.free_blocks_capacity)
-	{
-		new_capacity = FREE_BLOCKS_MAX_CAPACITY;
-	}
+	return check_free_blocks(*this, size, header_alignment, header_size);
+}
 
-	FreeBlock* mem =
-		(FreeBlock*)realloc(handler.free_blocks, sizeof(FreeBlock) * new_capacity);
-	if (mem == nullptr)
+/**
+ * @brief Carves up to `count` blocks back to back from [cursor, end) of arena
+ * `arena_index`, advancing `cursor` past the last one.
+ *
+ * Returns how many blocks fit.
+ **/
+static size_t carve_run(ArenaHandler& handler, const uint32_t arena_index,
+	uintptr_t& cursor, const uintptr_t end, const size_t count, const size_t size,
+	const uint8_t alignment, const uint8_t header_size, void** out_ptrs)
+{
+	MemoryArena& arena = handler.arenas[arena_index];
+	size_t carved = 0;
+	while (carved < count)
 	{
-		return ErrorCode::OutOfMemory;
+		void* aligned_ptr = align_allocation((void*)cursor, header_size, alignment);
+		const uintptr_t needed_end_addr = (uintptr_t)aligned_ptr + size;
+		if (needed_end_addr > end || !commit_arena(arena, needed_end_addr))
+		{
+			break;
+		}
+
+		write_allocation_header(header_size, aligned_ptr, cursor, needed_end_addr);
+		arena.live_bytes += header_size != 0 ? needed_end_addr - cursor : size;
+		if (header_size == 0)
+		{
+			reclaim_padding(handler, arena_index, cursor, (uintptr_t)aligned_ptr);
+		}
+
+		out_ptrs[carved++] = aligned_ptr;
+		cursor = needed_end_addr;
 	}
 
-	handler.free_blocks = mem;
-	handler.ds_info.free_blocks_capacity = new_capacity;
-	return ErrorCode::Success;
+	return carved;
 }
 
 /**
- * @brief Simply aligns `ptr` to the first aligned address, based on `alignment`,
- * greater than itself.
+ * @brief Carves as many of `count` blocks as fit from a single free block.
+ *
+ * Returns how many blocks were carved, which is 0 if no free block fits even one.
  **/
 [[nodiscard]]
-static inline void* align_forward(void* ptr, const uint8_t alignment)
+static size_t carve_free_block(ArenaHandler& handler, const size_t count,
+	const size_t size, const uint8_t alignment, const uint8_t header_size,
+	void** out_ptrs)
 {
-	return (void*)(((uintptr_t)ptr + (uintptr_t)alignment - 1) &
-		~((uintptr_t)alignment - 1));
+	if (handler.size_class_bitmap == 0)
+	{
+		return 0;
+	}
+
+	FreeBlock* free_block =
+		find_fitting_block(handler, size, alignment, header_size);
+	if (free_block == nullptr)
+	{
+		return 0;
+	}
+
+	// The record sits at the end of the block, so take the block out before
+	// carving and put back what is left afterwards.
+	const uint32_t arena_index = (uint32_t)free_block->arena_index;
+	uintptr_t cursor = (uintptr_t)free_block->ptr;
+	const uintptr_t end_addr = cursor + free_block->size;
+	remove_free_block(handler, free_block);
+
+	const size_t carved = carve_run(handler, arena_index, cursor, end_addr, count,
+		size, alignment, header_size, out_ptrs);
+
+	// The remainder touches no free block, as the block it came from was fully
+	// coalesced.
+	const size_t remainder = end_addr - cursor;
+	if (keeps_free_block(handler, (void*)cursor, remainder))
+	{
+		(void)insert_free_block(handler, arena_index, (void*)cursor, remainder);
+	}
+
+	else if (header_size != 0)
+	{
+		void* last_ptr = out_ptrs[carved - 1];
+		allocation_header(last_ptr)->usable_size = end_addr - (uintptr_t)last_ptr;
+		handler.arenas[arena_index].live_bytes += remainder;
+	}
+
+	else if (remainder != 0)
+	{
+		(void)bin_sliver(handler, (void*)cursor, remainder);
+	}
+
+	return carved;
 }
 
-[[nodiscard]]
-static inline void* check_free_blocks(
-	ArenaHandler& handler, const size_t size, const uint8_t alignment)
+ErrorCode ArenaHandler::request_memory_batch(const size_t count, const size_t size,
+	const uint8_t alignment, void** out_ptrs,
+	const bool use_default_allocation /* = true */)
 {
-	for (uint32_t ii = 0; ii < handler.ds_info.free_blocks_len; ii++)
+	if (size == 0)
+	{
+		return ErrorCode::InvalidArgument;
+	}
+
+	size_t done = 0;
+	if (mode == AllocationMode::Tlsf)
 	{
-		FreeBlock& free_block = handler.free_blocks[ii];
+		for (; done < count; done++)
+		{
+			out_ptrs[done] = request_memory(size, alignment, use_default_allocation);
+			if (out_ptrs[done] == nullptr)
+			{
+				break;
+			}
+		}
+	}
 
-		// Align the free block's pointer.
-		void* aligned_ptr = align_forward(free_block.ptr, alignment);
+	else
+	{
+		uint8_t header_size = 0;
+		uint8_t header_alignment = alignment;
+		header_layout(*this, header_size, header_alignment);
 
-		// Calculate the needed end address for the requested block.
-		//
-		// If the needed end address is past what the block contains, continue on.
-		const uintptr_t needed_end_addr = (uintptr_t)aligned_ptr + size;
-		const uintptr_t actual_end_addr =
-			(uintptr_t)free_block.ptr + free_block.size;
-		if (needed_end_addr > actual_end_addr)
+		// The most a single block can take up, padding included.
+		const size_t stride = header_size + size + header_alignment - 1;
+		if (count > SIZE_MAX / stride)
 		{
-			continue;
+			return ErrorCode::InvalidArgument;
 		}
 
-		// The remaining size in the block may be unnecessary to keep stored,
-		// bloating the number of free blocks.
-		//
-		// If it's smaller than a determined constant, just remove the block.
-		// This keeps things fast, although it does leak small amounts of usable
-		// memory from any arenas.
-		if (actual_end_addr - needed_end_addr < MIN_FREE_BLOCK_SIZE)
+		// Free blocks first, then the untouched memory of each arena.
+		while (done < count)
 		{
-			// Copy over other blocks if needed.
-			if (ii < handler.ds_info.free_blocks_len - 1)
+			const size_t carved = carve_free_block(*this, count - done, size,
+				header_alignment, header_size, out_ptrs + done);
+			if (carved == 0)
 			{
-				memmove(&handler.free_blocks[ii], &handler.free_blocks[ii + 1],
-					sizeof(FreeBlock) * (handler.ds_info.free_blocks_len - ii - 1));
+				break;
 			}
 
-			handler.ds_info.free_blocks_len--;
+			done += carved;
 		}
 
-		// Otherwise, just update the free block's info.
-		else
+		// Every arena the tree finds takes at least one block, or has its stale
+		// leaf refreshed.
+		while (done < count)
 		{
-			free_block.ptr = (void*)needed_end_addr;
-			free_block.size = actual_end_addr - needed_end_addr;
+			const uint32_t arena_index = find_arena_space(*this, stride);
+			if (arena_index == ARENAS_MAX_CAPACITY)
+			{
+				break;
+			}
+
+			MemoryArena& arena = arenas[arena_index];
+			uintptr_t cursor = (uintptr_t)arena.untouched_mem;
+			const size_t carved = carve_run(*this, arena_index, cursor,
+				(uintptr_t)arena.mem_block + arena.size, count - done, size,
+				header_alignment, header_size, out_ptrs + done);
+			arena.untouched_mem = (int8_t*)cursor;
+			update_arena_space(*this, arena_index);
+			done += carved;
+
+			// As in check_arenas, nothing carved from room the tree still sees
+			// means committing failed.
+			if (carved == 0 && arena_space_fits(*this, arena_index, stride))
+			{
+				break;
+			}
 		}
 
-		return aligned_ptr;
+		// Whatever is left comes from a single new arena.
+		if (done < count)
+		{
+			MemoryArena* arena =
+				create_arena(*this, (count - done) * stride, use_default_allocation);
+			if (arena != nullptr)
+			{
+				uintptr_t cursor = (uintptr_t)arena->mem_block;
+				done += carve_run(*this, (uint32_t)(arena - arenas), cursor,
+					(uintptr_t)arena->mem_block + arena->size, count - done, size,
+					header_alignment, header_size, out_ptrs + done);
+				arena->untouched_mem = (int8_t*)cursor;
+				update_arena_space(*this, (uint32_t)(arena - arenas));
+			}
+		}
 	}
 
-	return nullptr;
-}
-
-void* ArenaHandler::request_memory(const size_t size, const uint8_t alignment,
-	const bool use_default_allocation /* = true */)
-{
-	// First check if any free blocks have available memory.
-	if (void* ptr = check_free_blocks(*this, size, alignment); ptr != nullptr)
+	if (done == count)
 	{
-		return ptr;
+		return ErrorCode::Success;
 	}
 
-	// Check if any arenas have available space.
-	for (uint16_t ii = 0; ii < ds_info.arenas_len; ii++)
+	for (size_t ii = 0; ii < done; ii++)
 	{
-		MemoryArena& arena = arenas[ii];
+		(void)free_memory(out_ptrs[ii], size);
+	}
 
-		// Align the arena's untouched pointer.
-		void* aligned_ptr = align_forward(arena.untouched_mem, alignment);
+	return ErrorCode::OutOfMemory;
+}
 
-		// Calculate the needed end address and the actual end address of the arena.
-		//
-		// If there's not enough space, continue.
-		const uintptr_t needed_end_addr = (uintptr_t)aligned_ptr + size;
-		const uintptr_t actual_end_addr = (uintptr_t)arena.mem_block + arena.size;
-		if (needed_end_addr > actual_end_addr)
+/**
+ * @brief Notes that memory in arena `arena_index` was freed, releasing fully
+ * free arenas as the handler's retention and decay settings allow.
+ **/
+static inline void arena_freed(ArenaHandler& handler, const uint32_t arena_index)
+{
+	if (handler.arenas[arena_index].live_bytes != 0)
+	{
+		// Arenas held back for their decay wait on the next check instead.
+		if (handler.release_due_ms != 0 &&
+			++handler.frees_since_release_check >= RELEASE_CHECK_INTERVAL)
 		{
-			continue;
+			handler.frees_since_release_check = 0;
+			if (now_ms() >= handler.release_due_ms)
+			{
+				(void)release_free_arenas(
+					handler, handler.retained_free_arenas, handler.arena_decay_ms);
+			}
 		}
 
-		// Update the arena's info if data is used.
-		arena.untouched_mem = (int8_t*)needed_end_addr;
-		return aligned_ptr;
+		return;
+	}
+
+	handler.arenas[arena_index].free_since_ms = now_ms();
+	(void)release_free_arenas(
+		handler, handler.retained_free_arenas, handler.arena_decay_ms);
+}
+
+/**
+ * @brief Returns a TLSF allocation, taking it off its arena's live bytes.
+ * Emptied arenas are only timestamped; the next TLSF slow-path request or
+ * trim() releases them.
+ **/
+static inline void tlsf_free_to_arenas(ArenaHandler& handler, void* ptr)
+{
+	const uint32_t arena_index = find_arena(handler, ptr);
+	MemoryArena& arena = handler.arenas[arena_index];
+	arena.live_bytes -= tlsf_block_size(ptr);
+	tlsf_free_memory(handler.tlsf, ptr);
+	if (arena.live_bytes == 0)
+	{
+		arena.free_since_ms = now_ms();
 	}
+}
 
-	// A new memory arena is needed at this point.
-	if (ds_info.arenas_len == ds_info.arenas_capacity)
+ErrorCode ArenaHandler::free_memory(void* ptr, const size_t size)
+{
+	if (!owns(ptr))
 	{
-		const ErrorCode result = resize_arenas(*this);
-		if (result == ErrorCode::OutOfMemory)
-		{
-			fprintf(stderr, "OOM error occurred in ArenaHandler.\n");
-			return nullptr;
-		}
+		return ErrorCode::InvalidArgument;
+	}
 
-		else if (result == ErrorCode::InsufficientResource)
-		{
-			fprintf(
-				stderr, "Max number of memory arenas created for ArenaHandler.\n");
-			return nullptr;
-		}
+	if (mode == AllocationMode::Tlsf)
+	{
+		tlsf_free_to_arenas(*this, ptr);
+		return ErrorCode::Success;
 	}
 
-	MemoryArena& arena = arenas[ds_info.arenas_len];
+	// The header covers alignment padding the caller doesn't know about.
+	if (track_allocation_sizes)
+	{
+		return free_memory(ptr);
+	}
 
-	// Given the purpose of memory arenas is performance, allocate more than
-	// requested.
-	//
-	// If the requested amount is smaller than the default allocation (and the
-	// default allocation is desired), use the default allocation amount.
-	size_t mem_amount = size * 3;
-	if (use_default_allocation && mem_amount < DEFAULT_MEMORY_ARENA_ALLOCATION)
+	const uint32_t arena_index = find_arena(*this, ptr);
+	arenas[arena_index].live_bytes -= size;
+	free_region(*this, arena_index, ptr, size);
+	arena_freed(*this, arena_index);
+	return ErrorCode::Success;
+}
+
+ErrorCode ArenaHandler::free_memory(void* ptr)
+{
+	if (!owns(ptr))
 	{
-		mem_amount = DEFAULT_MEMORY_ARENA_ALLOCATION;
+		return ErrorCode::InvalidArgument;
 	}
 
-	arena.mem_block = (int8_t*)malloc(mem_amount);
-	if (arena.mem_block == nullptr)
+	if (mode == AllocationMode::Tlsf)
 	{
-		fprintf(stderr, "Failed to allocate memory in new memory arena.\n");
-		return nullptr;
+		tlsf_free_to_arenas(*this, ptr);
+		return ErrorCode::Success;
 	}
 
-	void* aligned_ptr = align_forward(arena.mem_block, alignment);
-	arena.size = mem_amount;
-	ds_info.arenas_len++;
-	arena.untouched_mem = (int8_t*)((uintptr_t)aligned_ptr + size);
-	return aligned_ptr;
+	if (!track_allocation_sizes)
+	{
+		return ErrorCode::InvalidArgument;
+	}
+
+	const AllocationHeader header = *allocation_header(ptr);
+	const size_t size = header.offset + header.usable_size;
+	const uint32_t arena_index = find_arena(*this, ptr);
+	arenas[arena_index].live_bytes -= size;
+	free_region(*this, arena_index, (int8_t*)ptr - header.offset, size);
+	arena_freed(*this, arena_index);
+	return ErrorCode::Success;
 }
 
-ErrorCode ArenaHandler::free_memory(void* ptr, const size_t size)
+/**
+ * @brief Sorts `requests` by address with an LSD radix sort, one byte per pass.
+ *
+ * Passes over bytes every address shares, typically the high ones, are skipped.
+ * Returns false if no scratch memory could be allocated.
+ **/
+[[nodiscard]]
+static bool sort_free_requests(FreeRequest* requests, const size_t count)
 {
-	// Find the appropriate location in the sorted array for ptr.
-	uint32_t low = 0;
-	uint32_t high = ds_info.free_blocks_len;
-	while (low < high)
+	FreeRequest* scratch = (FreeRequest*)malloc(sizeof(FreeRequest) * count);
+	if (scratch == nullptr)
 	{
-		uint32_t mid = low + ((high - low) / 2);
-		if ((uintptr_t)free_blocks[mid].ptr < (uintptr_t)ptr)
+		return false;
+	}
+
+	FreeRequest* from = requests;
+	FreeRequest* to = scratch;
+	for (uint8_t shift = 0; shift < sizeof(uintptr_t) * 8; shift += 8)
+	{
+		size_t offsets[256] = {};
+		for (size_t ii = 0; ii < count; ii++)
 		{
-			low = mid + 1;
+			offsets[((uintptr_t)from[ii].ptr >> shift) & 0xff]++;
 		}
 
-		else
+		if (offsets[((uintptr_t)from[0].ptr >> shift) & 0xff] == count)
 		{
-			high = mid;
+			continue;
+		}
+
+		size_t total = 0;
+		for (size_t& offset : offsets)
+		{
+			const size_t digit_count = offset;
+			offset = total;
+			total += digit_count;
+		}
+
+		for (size_t ii = 0; ii < count; ii++)
+		{
+			to[offsets[((uintptr_t)from[ii].ptr >> shift) & 0xff]++] = from[ii];
 		}
+
+		FreeRequest* swap = from;
+		from = to;
+		to = swap;
+	}
+
+	if (from != requests)
+	{
+		memcpy((void*)requests, (void*)from, sizeof(FreeRequest) * count);
 	}
 
-	const uint32_t idx = low;
-	bool merge_left = false;
-	if (idx > 0)
+	free(scratch);
+	return true;
+}
+
+ErrorCode ArenaHandler::free_memory_batch(FreeRequest* requests, const size_t count)
+{
+	// Checked up front so a bad pointer leaves the whole batch allocated.
+	for (size_t ii = 0; ii < count; ii++)
 	{
-		FreeBlock& left_block = free_blocks[idx - 1];
-		if ((uintptr_t)left_block.ptr + left_block.size == (uintptr_t)ptr)
+		if (!owns(requests[ii].ptr))
 		{
-			merge_left = true;
+			return ErrorCode::InvalidArgument;
 		}
 	}
 
-	bool merge_right = false;
-	if (idx < ds_info.free_blocks_len)
+	if (mode == AllocationMode::Tlsf)
 	{
-		FreeBlock& right_block = free_blocks[idx];
-		if ((uintptr_t)ptr + size == (uintptr_t)right_block.ptr)
+		for (size_t ii = 0; ii < count; ii++)
 		{
-			merge_right = true;
+			tlsf_free_to_arenas(*this, requests[ii].ptr);
 		}
+
+		return ErrorCode::Success;
 	}
 
-	// Case 1: -- Merge [left .. new .. right] into single block.
-	if (merge_left && merge_right)
+	if (count == 0)
 	{
-		FreeBlock& left_block = free_blocks[idx - 1];
-		FreeBlock& right_block = free_blocks[idx];
+		return ErrorCode::Success;
+	}
 
-		left_block.size += size + right_block.size;
-		if (idx < ds_info.free_blocks_len - 1)
+	// Headers give the full region of each allocation, padding included.
+	if (track_allocation_sizes)
+	{
+		for (size_t ii = 0; ii < count; ii++)
 		{
-			memmove(&free_blocks[idx], &free_blocks[idx + 1],
-				sizeof(FreeBlock) * (ds_info.free_blocks_len - (idx + 1)));
+			const AllocationHeader header = *allocation_header(requests[ii].ptr);
+			requests[ii].ptr = (int8_t*)requests[ii].ptr - header.offset;
+			requests[ii].size = header.offset + header.usable_size;
 		}
+	}
 
-		ds_info.free_blocks_len--;
-		return ErrorCode::Success;
+	if (!sort_free_requests(requests, count))
+	{
+		fprintf(stderr, "OOM error occurred in ArenaHandler.\n");
+		return ErrorCode::OutOfMemory;
 	}
 
-	// Case 2: -- Merge [left .. new] into single block.
-	if (merge_left)
+	// Sorted, each run of touching allocations within one arena goes to the free
+	// blocks as a single region.
+	size_t ii = 0;
+	while (ii < count)
 	{
-		free_blocks[idx - 1].size += size;
-		return ErrorCode::Success;
+		const uint32_t arena_index = find_arena(*this, requests[ii].ptr);
+		MemoryArena& arena = arenas[arena_index];
+		const uintptr_t arena_end = (uintptr_t)arena.mem_block + arena.size;
+
+		void* ptr = requests[ii].ptr;
+		size_t size = requests[ii].size;
+		for (ii++; ii < count && (uintptr_t)ptr + size == (uintptr_t)requests[ii].ptr &&
+			(uintptr_t)requests[ii].ptr != arena_end;
+			ii++)
+		{
+			size += requests[ii].size;
+		}
+
+		arena.live_bytes -= size;
+		free_region(*this, arena_index, ptr, size);
+		arena_freed(*this, arena_index);
 	}
 
-	// Case 3: -- Merge [new .. right] into single block.
-	if (merge_right)
+	return ErrorCode::Success;
+}
+
+size_t ArenaHandler::purge_free_blocks()
+{
+	if (mode == AllocationMode::Tlsf)
 	{
-		FreeBlock& right_block = free_blocks[idx];
-		right_block.ptr = ptr;
-		right_block.size += size;
-		return ErrorCode::Success;
+		return 0;
 	}
 
-	// Case 4: Place new block in sorted free blocks array.
-	if (ds_info.free_blocks_len == ds_info.free_blocks_capacity)
+	size_t purged = 0;
+	uint64_t bitmap = size_class_bitmap & (~0ull << size_class_of(purge_threshold));
+	while (bitmap != 0)
 	{
-		const ErrorCode result = resize_free_blocks(*this);
-		if (result == ErrorCode::OutOfMemory)
+		const uint8_t size_class = (uint8_t)__builtin_ctzll(bitmap);
+		bitmap &= bitmap - 1;
+		for (FreeBlock* block = size_class_heads[size_class]; block != nullptr;
+			block = block->next_in_class)
 		{
-			fprintf(stderr, "Failed to allocate memory for free blocks list.\n");
-			return result;
+			if (block->purged || block->size < purge_threshold)
+			{
+				continue;
+			}
+
+			// Stop short of the record, which must stay resident.
+			purged += purge_arena_memory(
+				(int8_t*)block->ptr, (uintptr_t)block - (uintptr_t)block->ptr);
+			block->purged = true;
 		}
+	}
 
-		else if (result == ErrorCode::InsufficientResource)
+	stats.bytes_purged += purged;
+	return purged;
+}
+
+ErrorCode ArenaHandler::add_seed_block(void* mem, const size_t size)
+{
+	if (mem == nullptr || size == 0)
+	{
+		return ErrorCode::InvalidArgument;
+	}
+
+	if (mode == AllocationMode::Tlsf && tlsf == nullptr)
+	{
+		tlsf = tlsf_create_control();
+		if (tlsf == nullptr)
 		{
-			fprintf(stderr, "Max number of free blocks reached in ArenaHandler.\n");
-			return result;
+			fprintf(stderr, "OOM error occurred in ArenaHandler.\n");
+			return ErrorCode::OutOfMemory;
 		}
 	}
 
-	if (idx < ds_info.free_blocks_len)
+	uint32_t index = 0;
+	if (!claim_arena_slot(*this, index))
 	{
-		memmove(&free_blocks[idx + 1], &free_blocks[idx],
-			sizeof(FreeBlock) * (ds_info.free_blocks_len - idx));
+		return ds_info.arenas_capacity == ARENAS_MAX_CAPACITY
+			? ErrorCode::InsufficientResource
+			: ErrorCode::OutOfMemory;
+	}
+
+	// TLSF manages the whole block as a pool, leaving nothing to bump.
+	if (mode == AllocationMode::Tlsf && !tlsf_add_pool(tlsf, mem, size))
+	{
+		return ErrorCode::InvalidArgument;
+	}
+
+	MemoryArena* arena =
+		install_arena(*this, index, (int8_t*)mem, size, ArenaBacking::Seeded);
+	if (mode == AllocationMode::Tlsf)
+	{
+		arena->untouched_mem = arena->mem_block + arena->size;
+		update_arena_space(*this, index);
 	}
 
-	FreeBlock& free_block = free_blocks[idx];
-	free_block.ptr = ptr;
-	free_block.size = size;
-	ds_info.free_blocks_len++;
 	return ErrorCode::Success;
 }
 
+size_t ArenaHandler::trim()
+{
+	return release_free_arenas(*this, 0, 0);
+}
+
+size_t ArenaHandler::usable_size(void* ptr) const
+{
+	if (mode == AllocationMode::Tlsf)
+	{
+		return tlsf_block_size(ptr);
+	}
+
+	if (!track_allocation_sizes)
+	{
+		return 0;
+	}
+
+	return allocation_header(ptr)->usable_size;
+}
+
+bool ArenaHandler::owns(const void* ptr) const
+{
+	if (ds_info.arenas_len == released_arenas_len)
+	{
+		return false;
+	}
+
+	const MemoryArena& arena = arenas[find_arena(*this, ptr)];
+	return (uintptr_t)ptr >= (uintptr_t)arena.mem_block &&
+		(uintptr_t)ptr < (uintptr_t)arena.mem_block + arena.size;
+}
+
 } // namespace mem_arena_handler
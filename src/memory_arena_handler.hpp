@@ -7,16 +7,111 @@
 namespace mem_arena_handler
 {
 
-constexpr uint8_t ARENA_DS_BITS = 12;
-constexpr uint8_t FREE_BLOCKS_DS_BITS = 20;
+constexpr uint8_t FREE_BLOCK_SIZE_CLASSES = 64;
+
+// Blocks tried per boundary size class before a fit search gives up.
+constexpr uint32_t FIT_SCAN_LIMIT = 8;
+
+// Frees between checks for free arenas whose decay has run out.
+constexpr uint32_t RELEASE_CHECK_INTERVAL = 64;
+constexpr size_t DEFAULT_ARENA_SIZE = 1 << 20;
+constexpr uint8_t DEFAULT_REQUEST_GROWTH_FACTOR = 3;
+constexpr uint8_t DEFAULT_ARENA_GROWTH_FACTOR = 2;
+constexpr size_t DEFAULT_MAX_ARENA_SIZE =
+	(size_t)(sizeof(void*) == 8 ? 1ull << 28 : 1ull << 26);
+constexpr uint32_t DEFAULT_INITIAL_ARENAS_CAPACITY = 3;
+constexpr size_t DEFAULT_MIN_FREE_BLOCK_SIZE = 256;
+constexpr size_t DEFAULT_ARENA_RETIRE_THRESHOLD = 4096;
+constexpr size_t DEFAULT_PURGE_THRESHOLD = 1 << 16;
+constexpr uint16_t DEFAULT_RETAINED_FREE_ARENAS = 1;
+constexpr uint32_t DEFAULT_ARENA_DECAY_MS = 1000;
+constexpr size_t DEFAULT_RESERVATION_SIZE =
+	(size_t)(sizeof(void*) == 8 ? 1ull << 36 : 1ull << 30);
 
 enum class ErrorCode : uint8_t
 {
 	Success = 0,
 	OutOfMemory = 1,
-	InsufficientResource = 2
+	InsufficientResource = 2,
+	InvalidArgument = 3
+};
+
+enum class AllocationMode : uint8_t
+{
+	// Exact-size blocks carved from arenas, with free blocks tracked on the side.
+	SegregatedFit = 0,
+
+	// Two-level segregated fit inside the arenas, using boundary tags for O(1)
+	// worst-case allocation and free. Every allocation carries a 16 byte header,
+	// and the size passed to free_memory is ignored. Frees never release
+	// arenas; emptied ones go on the next request that needs a new arena, or
+	// on trim().
+	Tlsf = 1
+};
+
+enum class ArenaBacking : uint8_t
+{
+	// Arenas are malloc'd.
+	Malloc = 0,
+
+	// Arenas are mmap'd on a 2MB boundary, rounded up to whole 2MB pages and
+	// advised with MADV_HUGEPAGE, so transparent huge pages can back them.
+	// Falls back to Malloc where mmap is unavailable.
+	Mmap = 1,
+
+	// Arenas are mapped from the reserved huge page pool with MAP_HUGETLB,
+	// falling back to Mmap when the pool is empty.
+	MmapHugeTlb = 2,
+
+	// A single arena reserves `reservation_size` bytes of address space up front
+	// and commits it in 2MB steps as the bump pointer advances. No further arenas
+	// are created, so requests fail once the reservation is used up. TLSF mode
+	// needs its pools committed in full and uses Mmap instead.
+	Reserved = 3,
+
+	// Arenas are acquired from and released to the handler's `upstream`
+	// allocator.
+	Upstream = 4,
+
+	// Arenas are only ever the caller-owned blocks passed to add_seed_block, and
+	// requests fail once those are used up. Seed blocks are never freed, whatever
+	// the handler's backing.
+	Seeded = 5
+};
+
+/**
+ * @brief Callbacks supplying arena memory for the Upstream backing, such as
+ * pages from a pinned region or another allocator.
+ *
+ * `acquire` returns at least `size` bytes or nullptr. `release` gets back what
+ * `acquire` returned along with its size; without it, upstream arenas are kept
+ * until the handler is destroyed and then simply dropped.
+ **/
+struct UpstreamAllocator
+{
+	void* (*acquire)(size_t size, void* user_data) = nullptr;
+	void (*release)(void* mem, size_t size, void* user_data) = nullptr;
+	void* user_data = nullptr;
 };
 
+/**
+ * @brief Callbacks told when an arena's address range joins or leaves the
+ * handler, for callers tracking which handler owns a pointer.
+ *
+ * Both run inside the handler's own calls, `released` before the memory is given
+ * back. Decommitted Reserved arenas keep their range, and the handler's
+ * destructor reports nothing.
+ **/
+struct ArenaObserver
+{
+	void (*installed)(void* mem, size_t size, void* user_data) = nullptr;
+	void (*released)(void* mem, size_t size, void* user_data) = nullptr;
+	void* user_data = nullptr;
+};
+
+struct TlsfControl;
+struct FreeBlock;
+
 struct MemoryArena
 {
 	~MemoryArena();
@@ -24,36 +119,338 @@ struct MemoryArena
 	int8_t* mem_block = nullptr;
 	int8_t* untouched_mem = nullptr;
 	size_t size = 0;
+
+	// How `mem_block` was obtained, and so how it is released.
+	ArenaBacking backing = ArenaBacking::Malloc;
+
+	// End of the memory that may be touched. Only Reserved arenas stop short of
+	// `mem_block + size`.
+	int8_t* committed_end = nullptr;
+
+	// The arena's free blocks, ordered by address. Coalescing only searches here,
+	// so a free block never spans two arenas.
+	FreeBlock* free_block_root = nullptr;
+
+	// Bytes handed out from the arena and not yet freed. Zero once every
+	// allocation in it has been freed, at which point the arena may be released.
+	size_t live_bytes = 0;
+
+	// When `live_bytes` last dropped to zero, in steady clock milliseconds.
+	uint64_t free_since_ms = 0;
 };
 
+/**
+ * @brief Record describing the free region [ptr, ptr + size).
+ *
+ * Records live inside the free memory they describe, at the end of the region,
+ * so tracking free memory needs no separate allocation. Regions too small to hold
+ * one are not tracked.
+ **/
 struct FreeBlock
 {
 	void* ptr = nullptr;
 	size_t size = 0;
+
+	// Neighbours in the size class list.
+	FreeBlock* prev_in_class = nullptr;
+	FreeBlock* next_in_class = nullptr;
+
+	// Children in the owning arena's address-ordered treap.
+	FreeBlock* left = nullptr;
+	FreeBlock* right = nullptr;
+	uint32_t priority = 0;
+
+	// Index of the arena the block lies in.
+	uint32_t arena_index : 31;
+
+	// Set once the pages inside the block have been purged, so they may read back
+	// as zero or stale and are no longer resident. Cleared when the block merges
+	// with unpurged memory.
+	uint32_t purged : 1;
+};
+
+/**
+ * @brief Record describing a sliver, a free region smaller than the handler's
+ * `min_free_block_size`.
+ *
+ * Slivers are binned by power-of-two size in singly linked lists, stored at the
+ * end of the region like FreeBlock records, and only merged back with their
+ * neighbours lazily.
+ **/
+struct SliverBlock
+{
+	void* ptr = nullptr;
+	size_t size = 0;
+	SliverBlock* next = nullptr;
 };
 
+/**
+ * @brief An allocation passed to ArenaHandler::free_memory_batch.
+ **/
+struct FreeRequest
+{
+	void* ptr = nullptr;
+	size_t size = 0;
+};
+
+// Plain counters, so updating one on the hot path is a single store rather than a
+// read-modify-write of a shared packed word.
 struct HandlerDataStructureInfo
 {
-	uint64_t arenas_len : ARENA_DS_BITS;
-	uint64_t arenas_capacity : ARENA_DS_BITS;
-	uint64_t free_blocks_len : FREE_BLOCKS_DS_BITS;
-	uint64_t free_blocks_capacity : FREE_BLOCKS_DS_BITS;
+	uint32_t arenas_len = 0;
+	uint32_t arenas_capacity = 0;
+	size_t free_blocks_len = 0;
+};
+
+struct HandlerStats
+{
+	// Alignment padding skipped in front of allocations, split by whether it was
+	// returned to the free blocks or sliver bins, or was too small to track.
+	size_t padding_bytes_reclaimed = 0;
+	size_t padding_bytes_lost = 0;
+
+	// Bytes currently held in the sliver bins.
+	size_t sliver_bytes = 0;
+
+	// Bytes in regions too small to hold even a SliverBlock record, including
+	// lost padding.
+	size_t dropped_bytes = 0;
+
+	// Fully free arenas given back to the system, and their total size.
+	size_t arenas_released = 0;
+	size_t bytes_released = 0;
+
+	// Bytes of free block pages purged by purge_free_blocks.
+	size_t bytes_purged = 0;
+};
+
+/**
+ * @brief Tuning for an ArenaHandler, fixed at construction.
+ *
+ * The defaults match a default constructed handler. Each field mirrors the
+ * ArenaHandler member of the same name.
+ **/
+struct ArenaHandlerConfig
+{
+	// Size of arenas created for requests using the default allocation.
+	size_t arena_size = DEFAULT_ARENA_SIZE;
+
+	// Arenas hold at least this many times the request that created them, so
+	// requests larger than `arena_size` leave room for more of their kind.
+	uint8_t request_growth_factor = DEFAULT_REQUEST_GROWTH_FACTOR;
+
+	// Each arena the handler holds multiplies the size of the next default
+	// allocation by this, up to `max_arena_size`. 1 keeps every arena at
+	// `arena_size`.
+	uint8_t arena_growth_factor = DEFAULT_ARENA_GROWTH_FACTOR;
+	size_t max_arena_size = DEFAULT_MAX_ARENA_SIZE;
+
+	// Arena slots allocated up front, before the metadata arrays start doubling.
+	uint32_t initial_arenas_capacity = DEFAULT_INITIAL_ARENAS_CAPACITY;
+
+	size_t min_free_block_size = DEFAULT_MIN_FREE_BLOCK_SIZE;
+	size_t arena_retire_threshold = DEFAULT_ARENA_RETIRE_THRESHOLD;
+	size_t purge_threshold = DEFAULT_PURGE_THRESHOLD;
+	uint16_t retained_free_arenas = DEFAULT_RETAINED_FREE_ARENAS;
+	uint32_t arena_decay_ms = DEFAULT_ARENA_DECAY_MS;
+	ArenaBacking arena_backing = ArenaBacking::Malloc;
+	UpstreamAllocator upstream = {};
+	size_t reservation_size = DEFAULT_RESERVATION_SIZE;
+	AllocationMode mode = AllocationMode::SegregatedFit;
+	bool track_allocation_sizes = false;
 };
 
 struct ArenaHandler
 {
+	ArenaHandler() = default;
+
+	/**
+	 * @brief Builds a handler tuned by `config`. Out of range values are clamped
+	 * to the nearest usable one.
+	 **/
+	explicit ArenaHandler(const ArenaHandlerConfig& config);
+
 	~ArenaHandler();
 
 	[[nodiscard]]
 	void* request_memory(const size_t size, const uint8_t alignment,
 		const bool use_default_allocation = true);
 
+	/**
+	 * @brief Serves a request from the sliver bins and free blocks only, without
+	 * bumping an arena or creating one. Returns nullptr on a miss, and always in
+	 * TLSF mode.
+	 **/
+	[[nodiscard]]
+	void* request_free_memory(const size_t size, const uint8_t alignment);
+
+	/**
+	 * @brief Requests `count` blocks of `size` bytes at `alignment`, writing them
+	 * to `out_ptrs`.
+	 *
+	 * Blocks are carved back to back from as few free blocks and arenas as
+	 * possible, one fit search per run rather than per block. On failure nothing
+	 * stays allocated. Zero-sized blocks are an InvalidArgument.
+	 **/
+	[[nodiscard]]
+	ErrorCode request_memory_batch(const size_t count, const size_t size,
+		const uint8_t alignment, void** out_ptrs,
+		const bool use_default_allocation = true);
+
+	/**
+	 * @brief Frees the `size` byte allocation at `ptr`.
+	 *
+	 * Returns InvalidArgument if `ptr` doesn't lie in one of the handler's arenas.
+	 **/
 	[[nodiscard]]
 	ErrorCode free_memory(void* ptr, const size_t size);
 
+	/**
+	 * @brief Frees `ptr` without the caller passing its size.
+	 *
+	 * Only available in TLSF mode or with `track_allocation_sizes` set; otherwise,
+	 * or for a pointer outside the handler's arenas, returns InvalidArgument.
+	 **/
+	[[nodiscard]]
+	ErrorCode free_memory(void* ptr);
+
+	/**
+	 * @brief Frees `count` allocations at once.
+	 *
+	 * The batch is sorted by address and adjacent allocations are merged before
+	 * they reach the free blocks, so tearing down many objects costs one treap
+	 * update per contiguous run instead of one per allocation. `requests` is
+	 * reordered in place. Sizes are ignored where free_memory(ptr) would work. If
+	 * any pointer lies outside the handler's arenas, nothing is freed and
+	 * InvalidArgument is returned.
+	 **/
+	[[nodiscard]]
+	ErrorCode free_memory_batch(FreeRequest* requests, const size_t count);
+
+	/**
+	 * @brief Returns how many bytes may be used at `ptr`, which is at least the
+	 * size requested. Returns 0 when sizes are not tracked.
+	 **/
+	[[nodiscard]]
+	size_t usable_size(void* ptr) const;
+
+	/**
+	 * @brief Returns whether `ptr` lies inside one of the handler's arenas.
+	 **/
+	[[nodiscard]]
+	bool owns(const void* ptr) const;
+
+	/**
+	 * @brief Releases every fully free arena to the system right away, ignoring
+	 * `retained_free_arenas` and `arena_decay_ms`.
+	 *
+	 * Returns the number of bytes released.
+	 **/
+	size_t trim();
+
+	/**
+	 * @brief Hands the whole pages inside free blocks of at least
+	 * `purge_threshold` bytes back to the system with MADV_FREE, or
+	 * MADV_DONTNEED where that is unavailable. The blocks stay free and usable.
+	 *
+	 * Records at the end of each block stay resident. Blocks already purged are
+	 * skipped. Returns the number of bytes purged, which is always 0 in TLSF
+	 * mode or without madvise.
+	 **/
+	size_t purge_free_blocks();
+
+	/**
+	 * @brief Adds the caller-owned block [mem, mem + size) as an arena. The
+	 * handler never frees or releases it, and it must outlive the handler.
+	 *
+	 * With the Seeded backing, seed blocks are all the memory the handler uses.
+	 * Returns InvalidArgument for an empty block or one TLSF can't manage.
+	 **/
+	[[nodiscard]]
+	ErrorCode add_seed_block(void* mem, const size_t size);
+
 	HandlerDataStructureInfo ds_info = {};
 	MemoryArena* arenas = nullptr;
-	FreeBlock* free_blocks = nullptr;
+
+	// New arenas hold `arena_size` bytes, or `request_growth_factor` times the
+	// triggering request when that is larger or the default allocation isn't
+	// wanted. The first arena allocates room for `initial_arenas_capacity`.
+	size_t arena_size = DEFAULT_ARENA_SIZE;
+	uint8_t request_growth_factor = DEFAULT_REQUEST_GROWTH_FACTOR;
+
+	// The default allocation grows geometrically with the number of arenas held,
+	// `arena_size * arena_growth_factor ^ arenas` capped at `max_arena_size`, so
+	// large heaps need few arenas while small ones stay small. Released arenas
+	// stop counting, so sizes shrink back as the heap does.
+	uint8_t arena_growth_factor = DEFAULT_ARENA_GROWTH_FACTOR;
+	size_t max_arena_size = DEFAULT_MAX_ARENA_SIZE;
+	uint32_t initial_arenas_capacity = DEFAULT_INITIAL_ARENAS_CAPACITY;
+
+	// Indices into `arenas`, sorted by the address of each arena's memory block,
+	// so the arena owning a pointer can be found by binary search. Released
+	// arenas leave an empty slot in `arenas`, reused by the next new arena, and
+	// are left out.
+	uint32_t* arena_order = nullptr;
+	uint32_t released_arenas_len = 0;
+
+	// Fully free arenas beyond the `retained_free_arenas` most recently freed are
+	// released once they have stayed free for `arena_decay_ms`, so oscillating
+	// load doesn't map and unmap the same memory over and over. Reserved arenas
+	// are decommitted instead.
+	uint16_t retained_free_arenas = DEFAULT_RETAINED_FREE_ARENAS;
+	uint32_t arena_decay_ms = DEFAULT_ARENA_DECAY_MS;
+
+	// When the oldest free arena held back by `arena_decay_ms` may go, or 0 if
+	// none is waiting. Checked every RELEASE_CHECK_INTERVAL frees, so held arenas
+	// are released even if no other arena empties.
+	uint64_t release_due_ms = 0;
+	uint32_t frees_since_release_check = 0;
+
+	// Smallest free block purge_free_blocks considers.
+	size_t purge_threshold = DEFAULT_PURGE_THRESHOLD;
+
+	// The arena the bump path tries first. Arenas with less than
+	// `arena_retire_threshold` bytes left are retired once they fail a request,
+	// handing their tail to the free blocks.
+	uint32_t current_arena = 0;
+	size_t arena_retire_threshold = DEFAULT_ARENA_RETIRE_THRESHOLD;
+
+	// Max segment tree over each arena's untouched bytes, with the leaves starting
+	// at `arena_space_leaves`, so a miss finds an arena with room in O(log
+	// arenas).
+	size_t* arena_space = nullptr;
+	uint32_t arena_space_leaves = 0;
+
+	// Each arena's treap orders its own free blocks by address for coalescing,
+	// while the size class lists index every record by power-of-two size so a
+	// fitting block can be found without scanning them all.
+	uint64_t size_class_bitmap = 0;
+	FreeBlock* size_class_heads[FREE_BLOCK_SIZE_CLASSES] = {};
+
+	// Remainders smaller than `min_free_block_size` are binned as slivers rather
+	// than kept as free blocks.
+	size_t min_free_block_size = DEFAULT_MIN_FREE_BLOCK_SIZE;
+	uint64_t sliver_bitmap = 0;
+	SliverBlock* sliver_heads[FREE_BLOCK_SIZE_CLASSES] = {};
+
+	// Applies to arenas created from then on.
+	ArenaBacking arena_backing = ArenaBacking::Malloc;
+	UpstreamAllocator upstream = {};
+	ArenaObserver observer = {};
+
+	// Address space reserved by a Reserved arena, which caps the handler's memory.
+	size_t reservation_size = DEFAULT_RESERVATION_SIZE;
+
+	// Must be chosen before the first request.
+	AllocationMode mode = AllocationMode::SegregatedFit;
+
+	// In segregated-fit mode, store an 8 byte header before every allocation so
+	// it can be freed without its size. Alignment is raised to at least 8, and
+	// must be chosen before the first request.
+	bool track_allocation_sizes = false;
+
+	HandlerStats stats = {};
+	TlsfControl* tlsf = nullptr;
 };
 
 } // namespace mem_arena_handler
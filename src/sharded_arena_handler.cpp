@@ -0,0 +1,347 @@
+#include "sharded_arena_handler.hpp"
+
+#include <cstdio>
+#include <functional>
+#include <new>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace mem_arena_handler
+{
+
+ShardedArenaHandler::ShardedArenaHandler()
+	: ShardedArenaHandler(ArenaHandlerConfig())
+{
+}
+
+/**
+ * @brief Allocates a table of `capacity` empty arena ranges, or returns nullptr.
+ **/
+[[nodiscard]]
+static ShardRange* create_range_table(const uint32_t capacity)
+{
+	ShardRange* table = (ShardRange*)malloc(sizeof(ShardRange) * capacity);
+	if (table == nullptr)
+	{
+		return nullptr;
+	}
+
+	for (uint32_t ii = 0; ii < capacity; ii++)
+	{
+		new (&table[ii]) ShardRange();
+	}
+
+	return table;
+}
+
+static inline void copy_range(ShardRange& to, const ShardRange& from)
+{
+	to.start.store(from.start.load(std::memory_order_relaxed),
+		std::memory_order_relaxed);
+	to.end.store(from.end.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	to.shard.store(from.shard.load(std::memory_order_relaxed),
+		std::memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the index of the first of the `len` ranges in `table` starting
+ * after `addr`.
+ **/
+[[nodiscard]]
+static uint32_t upper_range(
+	const ShardRange* table, const uint32_t len, const uintptr_t addr)
+{
+	uint32_t low = 0;
+	uint32_t high = len;
+	while (low < high)
+	{
+		const uint32_t mid = (low + high) / 2;
+		if (table[mid].start.load(std::memory_order_relaxed) <= addr)
+		{
+			low = mid + 1;
+		}
+
+		else
+		{
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+/**
+ * @brief Lists shard `link.shard`'s new arena [mem, mem + size). Runs under the
+ * shard's `free_lock`.
+ **/
+static void range_installed(void* mem, const size_t size, void* user_data)
+{
+	const ShardLink& link = *(const ShardLink*)user_data;
+	ShardedArenaHandler& sharded = *link.owner;
+	sharded.ranges_lock.lock();
+
+	// Growing copies into a new table before the edit, so lookups see the same
+	// ranges whichever table they read.
+	uint8_t table_index = sharded.range_table.load(std::memory_order_relaxed);
+	const uint32_t len = sharded.ranges_len.load(std::memory_order_relaxed);
+	if (len == INITIAL_SHARD_RANGES_CAPACITY << table_index)
+	{
+		ShardRange* grown = table_index + 1 < SHARD_RANGE_TABLES_MAX
+			? create_range_table(INITIAL_SHARD_RANGES_CAPACITY << (table_index + 1))
+			: nullptr;
+		if (grown == nullptr)
+		{
+			fprintf(stderr, "OOM error occurred in ShardedArenaHandler.\n");
+			sharded.ranges_incomplete.store(true, std::memory_order_relaxed);
+			sharded.ranges_lock.unlock();
+			return;
+		}
+
+		for (uint32_t ii = 0; ii < len; ii++)
+		{
+			copy_range(grown[ii], sharded.range_tables[table_index][ii]);
+		}
+
+		sharded.range_tables[++table_index] = grown;
+		sharded.range_table.store(table_index, std::memory_order_release);
+	}
+
+	ShardRange* table = sharded.range_tables[table_index];
+	const uintptr_t start = (uintptr_t)mem;
+	const uint32_t index = upper_range(table, len, start);
+
+	const uint64_t seq = sharded.ranges_seq.load(std::memory_order_relaxed);
+	sharded.ranges_seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (uint32_t ii = len; ii > index; ii--)
+	{
+		copy_range(table[ii], table[ii - 1]);
+	}
+
+	table[index].start.store(start, std::memory_order_relaxed);
+	table[index].end.store(start + size, std::memory_order_relaxed);
+	table[index].shard.store(link.shard, std::memory_order_relaxed);
+	sharded.ranges_len.store(len + 1, std::memory_order_relaxed);
+	sharded.ranges_seq.store(seq + 2, std::memory_order_release);
+	sharded.ranges_lock.unlock();
+}
+
+/**
+ * @brief Drops the released arena at `mem` from the ranges. Runs under the
+ * shard's `free_lock`, before the memory is given back.
+ **/
+static void range_released(void* mem, const size_t, void* user_data)
+{
+	ShardedArenaHandler& sharded = *((const ShardLink*)user_data)->owner;
+	sharded.ranges_lock.lock();
+	ShardRange* table =
+		sharded.range_tables[sharded.range_table.load(std::memory_order_relaxed)];
+	const uint32_t len = sharded.ranges_len.load(std::memory_order_relaxed);
+	const uint32_t index = upper_range(table, len, (uintptr_t)mem);
+
+	// Arenas that couldn't be listed aren't found.
+	if (index == 0 ||
+		table[index - 1].start.load(std::memory_order_relaxed) != (uintptr_t)mem)
+	{
+		sharded.ranges_lock.unlock();
+		return;
+	}
+
+	const uint64_t seq = sharded.ranges_seq.load(std::memory_order_relaxed);
+	sharded.ranges_seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (uint32_t ii = index; ii < len; ii++)
+	{
+		copy_range(table[ii - 1], table[ii]);
+	}
+
+	sharded.ranges_len.store(len - 1, std::memory_order_relaxed);
+	sharded.ranges_seq.store(seq + 2, std::memory_order_release);
+	sharded.ranges_lock.unlock();
+}
+
+ShardedArenaHandler::ShardedArenaHandler(
+	const ArenaHandlerConfig& config, uint32_t shards_len)
+{
+	if (shards_len == 0)
+	{
+		shards_len = std::thread::hardware_concurrency();
+	}
+
+	if (shards_len == 0)
+	{
+		shards_len = 1;
+	}
+
+	shards = (ConcurrentArenaHandler*)malloc(
+		sizeof(ConcurrentArenaHandler) * shards_len);
+	shard_links = (ShardLink*)malloc(sizeof(ShardLink) * shards_len);
+	range_tables[0] = create_range_table(INITIAL_SHARD_RANGES_CAPACITY);
+	if (shards == nullptr || shard_links == nullptr || range_tables[0] == nullptr)
+	{
+		fprintf(stderr, "OOM error occurred in ShardedArenaHandler.\n");
+		free(shards);
+		free(shard_links);
+		free(range_tables[0]);
+		shards = nullptr;
+		shard_links = nullptr;
+		range_tables[0] = nullptr;
+		return;
+	}
+
+	for (uint32_t ii = 0; ii < shards_len; ii++)
+	{
+		new (&shard_links[ii]) ShardLink();
+		shard_links[ii].owner = this;
+		shard_links[ii].shard = ii;
+
+		new (&shards[ii]) ConcurrentArenaHandler(config);
+		shards[ii].handler.observer.installed = range_installed;
+		shards[ii].handler.observer.released = range_released;
+		shards[ii].handler.observer.user_data = &shard_links[ii];
+	}
+
+	this->shards_len = shards_len;
+}
+
+ShardedArenaHandler::~ShardedArenaHandler()
+{
+	for (uint32_t ii = 0; ii < shards_len; ii++)
+	{
+		shards[ii].~ConcurrentArenaHandler();
+	}
+
+	free(shards);
+	free(shard_links);
+	for (ShardRange* table : range_tables)
+	{
+		free(table);
+	}
+}
+
+uint32_t ShardedArenaHandler::current_shard() const
+{
+	// glibc answers sched_getcpu from the thread's rseq area or the vDSO, so no
+	// system call is made on the common path.
+#ifdef __linux__
+	if (const int cpu = sched_getcpu(); cpu >= 0)
+	{
+		return (uint32_t)cpu % shards_len;
+	}
+#endif
+
+	return (uint32_t)(
+		std::hash<std::thread::id>()(std::this_thread::get_id()) % shards_len);
+}
+
+void* ShardedArenaHandler::request_memory(const size_t size, const uint8_t alignment)
+{
+	if (shards_len == 0)
+	{
+		return nullptr;
+	}
+
+	const uint32_t home = current_shard();
+	if (void* ptr = shards[home].request_memory(size, alignment); ptr != nullptr)
+	{
+		return ptr;
+	}
+
+	// The home shard couldn't grow. Take free memory from the others before
+	// growing any of them, so memory freed on other CPUs gets reused first.
+	for (uint8_t pass = 0; pass < 2; pass++)
+	{
+		for (uint32_t ii = 1; ii < shards_len; ii++)
+		{
+			ConcurrentArenaHandler& shard = shards[(home + ii) % shards_len];
+			void* ptr = pass == 0 ? shard.request_free_memory(size, alignment)
+								  : shard.request_memory(size, alignment);
+			if (ptr != nullptr)
+			{
+				overflowed_requests.fetch_add(1, std::memory_order_relaxed);
+				return ptr;
+			}
+		}
+	}
+
+	return nullptr;
+}
+
+uint32_t ShardedArenaHandler::find_shard(const void* ptr) const
+{
+	if (shards_len == 0)
+	{
+		return 0;
+	}
+
+	const uintptr_t addr = (uintptr_t)ptr;
+	while (true)
+	{
+		const uint64_t seq = ranges_seq.load(std::memory_order_acquire);
+		if ((seq & 1) != 0)
+		{
+			continue;
+		}
+
+		// A table read mid-edit may be inconsistent, but it is still allocated and
+		// the length is capped to it, so the search stays in bounds.
+		const uint8_t table_index = range_table.load(std::memory_order_acquire);
+		const ShardRange* table = range_tables[table_index];
+		uint32_t len = ranges_len.load(std::memory_order_relaxed);
+		if (len > INITIAL_SHARD_RANGES_CAPACITY << table_index)
+		{
+			len = INITIAL_SHARD_RANGES_CAPACITY << table_index;
+		}
+
+		const uint32_t index = upper_range(table, len, addr);
+		uint32_t shard = shards_len;
+		if (index != 0 && addr < table[index - 1].end.load(std::memory_order_relaxed))
+		{
+			shard = table[index - 1].shard.load(std::memory_order_relaxed);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (ranges_seq.load(std::memory_order_relaxed) == seq)
+		{
+			return shard;
+		}
+	}
+}
+
+ErrorCode ShardedArenaHandler::free_memory(void* ptr, const size_t size)
+{
+	const uint32_t shard = find_shard(ptr);
+	if (shard != shards_len)
+	{
+		if (shard != current_shard())
+		{
+			cross_shard_frees.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		return shards[shard].free_memory(ptr, size);
+	}
+
+	// Only arenas that couldn't be listed are missing from the table.
+	if (ranges_incomplete.load(std::memory_order_relaxed))
+	{
+		for (uint32_t ii = 0; ii < shards_len; ii++)
+		{
+			if (shards[ii].free_memory(ptr, size) == ErrorCode::Success)
+			{
+				if (ii != current_shard())
+				{
+					cross_shard_frees.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				return ErrorCode::Success;
+			}
+		}
+	}
+
+	return ErrorCode::InvalidArgument;
+}
+
+} // namespace mem_arena_handler
@@ -0,0 +1,127 @@
+#ifndef SHARDED_ARENA_HANDLER_HPP
+#define SHARDED_ARENA_HANDLER_HPP
+
+#include "concurrent_arena_handler.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+
+namespace mem_arena_handler
+{
+
+// Entries in the first table of arena ranges. Each replacement doubles it, so
+// the last of the tables alone could list 2^31 arenas.
+constexpr uint32_t INITIAL_SHARD_RANGES_CAPACITY = 64;
+constexpr uint8_t SHARD_RANGE_TABLES_MAX = 26;
+
+/**
+ * @brief The address range of one shard's arena. Fields are atomic because
+ * lookups read them while a writer may be shifting entries.
+ **/
+struct ShardRange
+{
+	std::atomic<uintptr_t> start = 0;
+	std::atomic<uintptr_t> end = 0;
+	std::atomic<uint32_t> shard = 0;
+};
+
+struct ShardedArenaHandler;
+
+/**
+ * @brief What a shard's ArenaObserver is handed, naming the shard.
+ **/
+struct ShardLink
+{
+	ShardedArenaHandler* owner = nullptr;
+	uint32_t shard = 0;
+};
+
+/**
+ * @brief One ConcurrentArenaHandler shard per CPU, so memory held back for reuse
+ * grows with the number of cores rather than the number of threads.
+ *
+ * Requests go to the shard of the CPU the calling thread is running on, found
+ * with sched_getcpu where available and by hashing the thread id elsewhere.
+ * Threads on different CPUs rarely meet on a lock, and a thread migrating
+ * mid-request only costs contention, since every shard is itself thread-safe.
+ *
+ * Frees look the pointer up in a table of every shard's arenas, kept sorted by
+ * address as shards install and release them, and go straight to the owning
+ * shard, so memory may be freed from any CPU.
+ *
+ * Shards aren't balanced by load. A shard serves its CPU's requests for as long
+ * as it can grow, which with the usual backings is until the system runs out of
+ * memory. Only once it can't, say a Seeded or Reserved shard that is used up,
+ * do its requests overflow onto the other shards, taking their free memory
+ * before growing them.
+ **/
+struct ShardedArenaHandler
+{
+	ShardedArenaHandler();
+
+	/**
+	 * @brief Builds `shards_len` shards tuned by `config`, or one per CPU when it
+	 * is 0.
+	 **/
+	explicit ShardedArenaHandler(
+		const ArenaHandlerConfig& config, uint32_t shards_len = 0);
+
+	~ShardedArenaHandler();
+
+	ShardedArenaHandler(const ShardedArenaHandler&) = delete;
+	ShardedArenaHandler& operator=(const ShardedArenaHandler&) = delete;
+
+	[[nodiscard]]
+	void* request_memory(const size_t size, const uint8_t alignment);
+
+	/**
+	 * @brief Frees `ptr` to whichever shard owns it, or returns InvalidArgument
+	 * if none does.
+	 **/
+	[[nodiscard]]
+	ErrorCode free_memory(void* ptr, const size_t size);
+
+	/**
+	 * @brief Returns the index of the shard serving the calling thread right now.
+	 **/
+	[[nodiscard]]
+	uint32_t current_shard() const;
+
+	/**
+	 * @brief Returns the index of the shard whose arenas hold `ptr`, or
+	 * `shards_len` if none do. Takes no locks.
+	 **/
+	[[nodiscard]]
+	uint32_t find_shard(const void* ptr) const;
+
+	ConcurrentArenaHandler* shards = nullptr;
+	uint32_t shards_len = 0;
+
+	ShardLink* shard_links = nullptr;
+
+	// Every shard's arenas, sorted by address. Writers hold `ranges_lock` and
+	// keep `ranges_seq` odd while they edit, and lookups retry if it changed
+	// under them. Outgrown tables are kept until destruction, as a lookup may
+	// still be reading one; with doubling they add up to less than the last.
+	std::mutex ranges_lock;
+	std::atomic<uint64_t> ranges_seq = 0;
+	ShardRange* range_tables[SHARD_RANGE_TABLES_MAX] = {};
+	std::atomic<uint8_t> range_table = 0;
+	std::atomic<uint32_t> ranges_len = 0;
+
+	// Set if an arena couldn't be listed for lack of memory. Lookups that miss
+	// then fall back to asking each shard.
+	std::atomic<bool> ranges_incomplete = false;
+
+	// Frees that landed on a shard other than the current CPU's, and requests
+	// that overflowed onto another shard after the current one couldn't grow.
+	// Only updated off the common path.
+	std::atomic<size_t> cross_shard_frees = 0;
+	std::atomic<size_t> overflowed_requests = 0;
+};
+
+} // namespace mem_arena_handler
+
+#endif // SHARDED_ARENA_HANDLER_HPP
@@ -1,7 +1,37 @@
+#include "basic_arena_handler.hpp"
+#include "concurrent_arena_handler.hpp"
 #include "memory_arena_handler.hpp"
+#include "sharded_arena_handler.hpp"
+#include "thread_cache.hpp"
 
 #include "gtest/gtest.h"
 
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Set to make committing memory fail, as it would if the system ran out.
+static bool fail_commits = false;
+
+// Replaces the C library's mprotect for the whole test binary.
+extern "C" int mprotect(void* addr, size_t len, int prot) noexcept
+{
+	if (fail_commits && (prot & PROT_WRITE) != 0)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+
+	return (int)syscall(SYS_mprotect, addr, len, prot);
+}
+#endif
+
 using namespace mem_arena_handler;
 
 class ArenaHandlerTest : public ::testing::Test
@@ -20,6 +50,62 @@ protected:
 	{
 		return handler.ds_info.free_blocks_len;
 	}
+
+	// Free blocks in address order, found by walking each arena's treap in order.
+	const FreeBlock& get_free_block(size_t ii)
+	{
+		const FreeBlock* found = nullptr;
+		for (size_t jj = 0; jj < get_arena_count() && found == nullptr; jj++)
+		{
+			find_in_order(
+				handler.arenas[handler.arena_order[jj]].free_block_root, ii, found);
+		}
+
+		return *found;
+	}
+
+	void find_in_order(const FreeBlock* block, size_t& ii, const FreeBlock*& found)
+	{
+		if (block == nullptr || found != nullptr)
+		{
+			return;
+		}
+
+		find_in_order(block->left, ii, found);
+		if (found == nullptr && ii-- == 0)
+		{
+			found = block;
+		}
+
+		find_in_order(block->right, ii, found);
+	}
+
+	size_t get_treap_height(const FreeBlock* block)
+	{
+		if (block == nullptr)
+		{
+			return 0;
+		}
+
+		const size_t left = get_treap_height(block->left);
+		const size_t right = get_treap_height(block->right);
+		return 1 + (left > right ? left : right);
+	}
+
+	// Bumps the handler's first arena so the next allocation starts `offset`
+	// bytes past a multiple of `alignment`, wherever the arena was placed.
+	// Returns where that allocation will start.
+	int8_t* bump_to_offset(const uintptr_t alignment, const uintptr_t offset)
+	{
+		const uintptr_t next = (uintptr_t)handler.request_memory(1, 1) + 1;
+		const uintptr_t filler = (offset + alignment - next % alignment) % alignment;
+		if (filler != 0)
+		{
+			EXPECT_NE(handler.request_memory(filler, 1), nullptr);
+		}
+
+		return (int8_t*)(next + filler);
+	}
 };
 
 TEST_F(ArenaHandlerTest, InitializationState)
@@ -146,8 +232,8 @@ TEST_F(ArenaHandlerTest, CoalescingFreeBlocks)
 
 	// Should result in 1 large free block
 	EXPECT_EQ(get_free_block_count(), 1);
-	EXPECT_EQ(handler.free_blocks[0].size, size * 3);
-	EXPECT_EQ(handler.free_blocks[0].ptr, pA);
+	EXPECT_EQ(get_free_block(0).size, size * 3);
+	EXPECT_EQ(get_free_block(0).ptr, pA);
 }
 
 TEST_F(ArenaHandlerTest, InvalidFreeHandling)
@@ -197,13 +283,13 @@ TEST_F(ArenaHandlerTest, FreeBlock_KeepLargeRemainder)
 	EXPECT_EQ(get_free_block_count(), 1);
 
 	// Verify the remaining size of the free block (Internal inspection)
-	EXPECT_EQ(handler.free_blocks[0].size, 500);
+	EXPECT_EQ(get_free_block(0).size, 500);
 }
 
-TEST_F(ArenaHandlerTest, FreeBlocks_ArrayResize)
+TEST_F(ArenaHandlerTest, FreeBlocks_ManyNonContiguous)
 {
-	// INITIAL_FREE_BLOCKS_CAPACITY is 50.
-	// We need to create > 50 non-contiguous free blocks to trigger a resize.
+	// Free blocks are tracked inside the freed memory, so there is no list to
+	// outgrow. Create plenty of non-contiguous blocks anyway.
 
 	const int num_blocks = 60;
 	void* ptrs[num_blocks];
@@ -225,7 +311,6 @@ TEST_F(ArenaHandlerTest, FreeBlocks_ArrayResize)
 	}
 
 	// We should now have 60 individual free blocks.
-	// This asserts that the vector resized successfully from 50 to 100.
 	EXPECT_EQ(get_free_block_count(), num_blocks);
 
 	// Verify logic still works by allocating one of them back
@@ -247,6 +332,9 @@ TEST_F(ArenaHandlerTest, Arenas_ArrayResize)
 
 	size_t size = 1024 * 1024; // 1MB
 
+	// Keep every arena at the default size so the counts above hold.
+	handler.arena_growth_factor = 1;
+
 	// We loop 15 times to safely guarantee we exceed the capacity of the first few
 	// arenas. Allocations 1-3   -> Arena 0 Allocations 4-6   -> Arena 1 Allocations
 	// 7-9   -> Arena 2 Allocations 10-12 -> Arena 3 (Resize triggered here or at 10
@@ -283,35 +371,32 @@ TEST_F(ArenaHandlerTest, Coverage_Fragmentation_AlignmentSkip)
 	// push the start pointer too far forward to fit the size.
 
 	// 1. Create a misaligned free block.
-	// Alloc A (1 byte) -> Pushes ptr to an odd address (likely) or just offsets it.
-	void* pA = handler.request_memory(1, 1);
-	ASSERT_NE(pA, nullptr); // Fix unused var warning
-
-	// Alloc B (64 bytes). This will be our target block.
+	// Alloc B (64 bytes) starts 23 bytes past a 64 byte boundary, so a 64-aligned
+	// request would need 41 bytes of padding inside it.
+	int8_t* start = bump_to_offset(64, 23);
 	void* pB = handler.request_memory(64, 1);
-	ASSERT_NE(pB, nullptr);
+	ASSERT_EQ(pB, start);
 
 	// Alloc C (1 byte) -> Prevents B from being the "last" block or merging right.
 	void* pC = handler.request_memory(1, 1);
-	ASSERT_NE(pC, nullptr); // Fix unused var warning
+	ASSERT_NE(pC, nullptr);
 
 	// Free B. We now have a 64-byte free block.
-	// Fix nodiscard warning
 	ASSERT_EQ(handler.free_memory(pB, 64), ErrorCode::Success);
 
 	// 2. Request memory that fits in 64 bytes (size 50),
 	// but requires high alignment (64) that forces padding.
-	// Use a large alignment to force the skip.
 	void* pNew = handler.request_memory(50, 64);
 	ASSERT_NE(pNew, nullptr);
 
-	// It should NOT reuse pB (unless pB happened to be perfectly 64-aligned
-	// already).
-	if (pNew != pB)
-	{
-		EXPECT_EQ(get_free_block_count(), 1);
-		EXPECT_EQ(handler.free_blocks[0].ptr, pB);
-	}
+	// pB is skipped, and the request comes from the arena after pC. The 40 bytes
+	// of padding skipped there are too small for a FreeBlock record, so they are
+	// binned as a sliver rather than becoming a second free block.
+	EXPECT_EQ((int8_t*)pNew, (int8_t*)pC + 1 + 40);
+	EXPECT_EQ(get_free_block_count(), 1);
+	EXPECT_EQ(get_free_block(0).ptr, pB);
+	EXPECT_EQ(handler.stats.padding_bytes_reclaimed, 40);
+	EXPECT_EQ(handler.stats.sliver_bytes, 40);
 }
 
 TEST_F(ArenaHandlerTest, Coverage_MergeLeftOnly)
@@ -331,8 +416,8 @@ TEST_F(ArenaHandlerTest, Coverage_MergeLeftOnly)
 
 	// Verify: 1 Free block, Size 200, Ptr == pA
 	EXPECT_EQ(get_free_block_count(), 1);
-	EXPECT_EQ(handler.free_blocks[0].size, 200);
-	EXPECT_EQ(handler.free_blocks[0].ptr, pA);
+	EXPECT_EQ(get_free_block(0).size, 200);
+	EXPECT_EQ(get_free_block(0).ptr, pA);
 }
 
 TEST_F(ArenaHandlerTest, Coverage_MergeRightOnly)
@@ -353,8 +438,8 @@ TEST_F(ArenaHandlerTest, Coverage_MergeRightOnly)
 
 	// Verify: 1 Free block, Size 200, Ptr == pB
 	EXPECT_EQ(get_free_block_count(), 1);
-	EXPECT_EQ(handler.free_blocks[0].size, 200);
-	EXPECT_EQ(handler.free_blocks[0].ptr, pB);
+	EXPECT_EQ(get_free_block(0).size, 200);
+	EXPECT_EQ(get_free_block(0).ptr, pB);
 }
 
 TEST_F(ArenaHandlerTest, Coverage_MergeBoth_ShiftTail)
@@ -393,12 +478,12 @@ TEST_F(ArenaHandlerTest, Coverage_MergeBoth_ShiftTail)
 	EXPECT_EQ(get_free_block_count(), 2);
 
 	// Check Block 0 (Merged A+B+C = 300 bytes)
-	EXPECT_EQ(handler.free_blocks[0].ptr, pA);
-	EXPECT_EQ(handler.free_blocks[0].size, 300);
+	EXPECT_EQ(get_free_block(0).ptr, pA);
+	EXPECT_EQ(get_free_block(0).size, 300);
 
 	// Check Block 1 (D = 100 bytes) - confirming it shifted correctly
-	EXPECT_EQ(handler.free_blocks[1].ptr, pD);
-	EXPECT_EQ(handler.free_blocks[1].size, 100);
+	EXPECT_EQ(get_free_block(1).ptr, pD);
+	EXPECT_EQ(get_free_block(1).size, 100);
 }
 TEST_F(ArenaHandlerTest, Coverage_InsertMiddle)
 {
@@ -423,7 +508,1888 @@ TEST_F(ArenaHandlerTest, Coverage_InsertMiddle)
 	EXPECT_EQ(handler.free_memory(pB, 100), ErrorCode::Success);
 
 	EXPECT_EQ(get_free_block_count(), 3);
-	EXPECT_EQ(handler.free_blocks[0].ptr, pA);
-	EXPECT_EQ(handler.free_blocks[1].ptr, pB); // Inserted here
-	EXPECT_EQ(handler.free_blocks[2].ptr, pC);
+	EXPECT_EQ(get_free_block(0).ptr, pA);
+	EXPECT_EQ(get_free_block(1).ptr, pB); // Inserted here
+	EXPECT_EQ(get_free_block(2).ptr, pC);
+}
+
+TEST_F(ArenaHandlerTest, SizeClass_LargerClassPreferred)
+{
+	// Many small free blocks, separated by barriers so they never merge.
+	const int num_blocks = 100;
+	void* ptrs[num_blocks];
+	for (int i = 0; i < num_blocks; ++i)
+	{
+		ptrs[i] = handler.request_memory(64, 1);
+		void* barrier = handler.request_memory(8, 1);
+		ASSERT_NE(barrier, nullptr);
+	}
+
+	void* big = handler.request_memory(8192, 1);
+	void* barrier = handler.request_memory(8, 1);
+	ASSERT_NE(barrier, nullptr);
+
+	for (int i = 0; i < num_blocks; ++i)
+	{
+		ASSERT_EQ(handler.free_memory(ptrs[i], 64), ErrorCode::Success);
+	}
+
+	ASSERT_EQ(handler.free_memory(big, 8192), ErrorCode::Success);
+	EXPECT_EQ(get_free_block_count(), num_blocks + 1);
+
+	// 64 and 8192 byte blocks live in different size classes.
+	EXPECT_NE(handler.size_class_bitmap & (1ull << 6), 0);
+	EXPECT_NE(handler.size_class_bitmap & (1ull << 13), 0);
+
+	// A 1000 byte request skips every 64 byte block and lands in the big one.
+	void* ptr = handler.request_memory(1000, 8);
+	EXPECT_EQ(ptr, big);
+	EXPECT_EQ(get_free_block_count(), num_blocks + 1);
+	EXPECT_EQ(get_free_block(num_blocks).size, 8192 - 1000);
+
+	// The remainder dropped to a lower size class.
+	EXPECT_EQ(handler.size_class_bitmap & (1ull << 13), 0);
+	EXPECT_NE(handler.size_class_bitmap & (1ull << 12), 0);
+}
+
+TEST_F(ArenaHandlerTest, SizeClass_RemoveFromSharedClass)
+{
+	void* pA = handler.request_memory(300, 1);
+	void* pad1 = handler.request_memory(8, 1);
+	void* pB = handler.request_memory(300, 1);
+	void* pad2 = handler.request_memory(8, 1);
+	void* pC = handler.request_memory(300, 1);
+	ASSERT_NE(pad1, nullptr);
+	ASSERT_NE(pad2, nullptr);
+
+	EXPECT_EQ(handler.free_memory(pA, 300), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(pB, 300), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(pC, 300), ErrorCode::Success);
+
+	// All three are in the same class; taking one whole unlinks it from the
+	// middle or end of that class list.
+	void* reused = handler.request_memory(300, 1);
+	EXPECT_NE(reused, nullptr);
+	ASSERT_EQ(get_free_block_count(), 2);
+
+	// The remaining blocks are still ordered and reachable via their class list.
+	EXPECT_LT((uintptr_t)get_free_block(0).ptr, (uintptr_t)get_free_block(1).ptr);
+	EXPECT_NE(handler.request_memory(300, 1), nullptr);
+	EXPECT_NE(handler.request_memory(300, 1), nullptr);
+	EXPECT_EQ(get_free_block_count(), 0);
+	EXPECT_EQ(handler.size_class_bitmap, 0);
+}
+
+TEST_F(ArenaHandlerTest, SizeClass_BoundaryScanIsCapped)
+{
+	// A fitting block behind more misfits than a search tries stays unused.
+	void* fitting = handler.request_memory(1000, 8);
+	ASSERT_NE(handler.request_memory(8, 8), nullptr);
+	void* misfits[FIT_SCAN_LIMIT + 1] = {};
+	for (void*& misfit : misfits)
+	{
+		misfit = handler.request_memory(600, 8);
+		ASSERT_NE(handler.request_memory(8, 8), nullptr);
+	}
+
+	EXPECT_EQ(handler.free_memory(fitting, 1000), ErrorCode::Success);
+	for (void* misfit : misfits)
+	{
+		EXPECT_EQ(handler.free_memory(misfit, 600), ErrorCode::Success);
+	}
+
+	void* bumped = handler.request_memory(1000, 8);
+	ASSERT_NE(bumped, nullptr);
+	EXPECT_NE(bumped, fitting);
+	EXPECT_EQ(get_free_block_count(), FIT_SCAN_LIMIT + 2);
+
+	// Once within the limit, the scan finds it again.
+	EXPECT_EQ(handler.request_memory(600, 8), misfits[FIT_SCAN_LIMIT]);
+	EXPECT_EQ(handler.request_memory(600, 8), misfits[FIT_SCAN_LIMIT - 1]);
+	EXPECT_EQ(handler.request_memory(1000, 8), fitting);
+}
+
+TEST_F(ArenaHandlerTest, Treap_StaysBalancedUnderAddressOrderedFrees)
+{
+	// Freeing in address order is the worst case for an unbalanced tree.
+	const int num_blocks = 4096;
+	void* ptrs[num_blocks];
+	for (int i = 0; i < num_blocks; ++i)
+	{
+		ptrs[i] = handler.request_memory(64, 1);
+		void* barrier = handler.request_memory(8, 1);
+		ASSERT_NE(barrier, nullptr);
+	}
+
+	for (int i = 0; i < num_blocks; ++i)
+	{
+		ASSERT_EQ(handler.free_memory(ptrs[i], 64), ErrorCode::Success);
+	}
+
+	ASSERT_EQ(get_free_block_count(), num_blocks);
+	EXPECT_LT(get_treap_height(handler.arenas[0].free_block_root), 48);
+
+	// In-order traversal matches address order.
+	for (int i = 0; i < num_blocks; i += 512)
+	{
+		EXPECT_EQ(get_free_block(i).ptr, ptrs[i]);
+	}
+}
+
+class TlsfArenaHandlerTest : public ::testing::Test
+{
+protected:
+	ArenaHandler handler;
+
+	void SetUp() override
+	{
+		handler.mode = AllocationMode::Tlsf;
+	}
+};
+
+TEST_F(TlsfArenaHandlerTest, BasicAllocationAndReuse)
+{
+	void* ptr = handler.request_memory(512, 8);
+	ASSERT_NE(ptr, nullptr);
+	EXPECT_EQ(handler.ds_info.arenas_len, 1);
+	EXPECT_EQ(handler.ds_info.free_blocks_len, 0);
+
+	// Freeing ignores the size, and the same block comes straight back.
+	EXPECT_EQ(handler.free_memory(ptr, 0), ErrorCode::Success);
+	EXPECT_EQ(handler.request_memory(512, 8), ptr);
+}
+
+TEST_F(TlsfArenaHandlerTest, AlignmentCheck)
+{
+	for (uint8_t alignment : {1, 8, 16, 32, 64, 128})
+	{
+		void* ptr = handler.request_memory(40, alignment);
+		ASSERT_NE(ptr, nullptr);
+		EXPECT_EQ((uintptr_t)ptr % alignment, 0);
+	}
+}
+
+TEST_F(TlsfArenaHandlerTest, CoalescingRestoresWholeArena)
+{
+	const int num_blocks = 64;
+	void* ptrs[num_blocks];
+	for (int i = 0; i < num_blocks; ++i)
+	{
+		ptrs[i] = handler.request_memory(1000, 8);
+		ASSERT_NE(ptrs[i], nullptr);
+	}
+
+	// Free in an interleaved order so blocks merge both left and right.
+	for (int i = 0; i < num_blocks; i += 2)
+	{
+		EXPECT_EQ(handler.free_memory(ptrs[i], 1000), ErrorCode::Success);
+	}
+
+	for (int i = 1; i < num_blocks; i += 2)
+	{
+		EXPECT_EQ(handler.free_memory(ptrs[i], 1000), ErrorCode::Success);
+	}
+
+	// With every neighbour merged, a request that only the whole arena's block
+	// can serve fits again. TLSF rounds requests up by one second-level step
+	// (1/16 here), so leave room for that.
+	void* big = handler.request_memory(handler.arenas[0].size * 31 / 32 - 1024, 8);
+	EXPECT_EQ(big, ptrs[0]);
+	EXPECT_EQ(handler.ds_info.arenas_len, 1);
+}
+
+TEST_F(TlsfArenaHandlerTest, NewArenaWhenPoolsAreFull)
+{
+	void* small = handler.request_memory(64, 8);
+	ASSERT_NE(small, nullptr);
+
+	size_t huge_size = 10 * 1024 * 1024;
+	void* huge = handler.request_memory(huge_size, 64);
+	ASSERT_NE(huge, nullptr);
+	EXPECT_EQ((uintptr_t)huge % 64, 0);
+	EXPECT_EQ(handler.ds_info.arenas_len, 2);
+
+	// The memory is writable end to end.
+	memset(huge, 0xAB, huge_size);
+}
+
+TEST_F(ArenaHandlerTest, FreeBlock_RecordLivesInFreedMemory)
+{
+	void* ptr = handler.request_memory(1000, 8);
+	void* barrier = handler.request_memory(8, 1);
+	ASSERT_NE(barrier, nullptr);
+
+	EXPECT_EQ(handler.free_memory(ptr, 1000), ErrorCode::Success);
+	ASSERT_EQ(get_free_block_count(), 1);
+
+	// The record is stored at the end of the freed region itself.
+	const uintptr_t record = (uintptr_t)handler.arenas[0].free_block_root;
+	EXPECT_GE(record, (uintptr_t)ptr);
+	EXPECT_LE(record + sizeof(FreeBlock), (uintptr_t)ptr + 1000);
+	EXPECT_EQ(handler.arenas[0].free_block_root->ptr, ptr);
+
+	// Carving from the front leaves the record where it was.
+	EXPECT_EQ(handler.request_memory(200, 8), ptr);
+	EXPECT_EQ((uintptr_t)handler.arenas[0].free_block_root, record);
+	EXPECT_EQ(get_free_block(0).size, 800);
+}
+
+TEST_F(ArenaHandlerTest, FreeBlock_TooSmallForRecord)
+{
+	void* pA = handler.request_memory(256, 8);
+	void* pB = handler.request_memory(16, 8);
+	void* pC = handler.request_memory(16, 8);
+	void* barrier = handler.request_memory(8, 8);
+	ASSERT_NE(barrier, nullptr);
+
+	// An isolated 16 byte region cannot hold its own record and is dropped.
+	EXPECT_EQ(handler.free_memory(pC, 16), ErrorCode::Success);
+	EXPECT_EQ(get_free_block_count(), 0);
+
+	// A 16 byte region next to a free block merges into it, moving the record to
+	// the new end of the block.
+	EXPECT_EQ(handler.free_memory(pA, 256), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(pB, 16), ErrorCode::Success);
+	ASSERT_EQ(get_free_block_count(), 1);
+	EXPECT_EQ(get_free_block(0).ptr, pA);
+	EXPECT_EQ(get_free_block(0).size, 272);
+	EXPECT_EQ((uintptr_t)handler.arenas[0].free_block_root + sizeof(FreeBlock),
+		(uintptr_t)pA + 272);
+}
+
+TEST_F(ArenaHandlerTest, SizelessFree_RequiresTracking)
+{
+	void* ptr = handler.request_memory(100, 8);
+	ASSERT_NE(ptr, nullptr);
+	EXPECT_EQ(handler.usable_size(ptr), 0);
+	EXPECT_EQ(handler.free_memory(ptr), ErrorCode::InvalidArgument);
+}
+
+TEST_F(ArenaHandlerTest, Free_RejectsForeignPointers)
+{
+	alignas(16) int8_t foreign[256];
+
+	// No arenas yet.
+	EXPECT_EQ(handler.free_memory(foreign, 256), ErrorCode::InvalidArgument);
+
+	void* ptr = handler.request_memory(100, 8);
+	ASSERT_NE(ptr, nullptr);
+	EXPECT_EQ(handler.free_memory(foreign, 256), ErrorCode::InvalidArgument);
+	handler.track_allocation_sizes = true;
+	EXPECT_EQ(handler.free_memory(foreign), ErrorCode::InvalidArgument);
+	handler.track_allocation_sizes = false;
+
+	// A bad pointer leaves the rest of the batch allocated.
+	FreeRequest requests[2] = {{ptr, 100}, {foreign, 256}};
+	EXPECT_EQ(handler.free_memory_batch(requests, 2), ErrorCode::InvalidArgument);
+	EXPECT_EQ(handler.arenas[0].live_bytes, 100);
+	EXPECT_EQ(get_free_block_count(), 0);
+
+	EXPECT_EQ(handler.free_memory(ptr, 100), ErrorCode::Success);
+	EXPECT_EQ(handler.arenas[0].live_bytes, 0);
+}
+
+TEST_F(ArenaHandlerTest, SizelessFree_TrackedAllocations)
+{
+	handler.track_allocation_sizes = true;
+
+	void* pA = handler.request_memory(100, 64);
+	void* pB = handler.request_memory(100, 1);
+	void* pC = handler.request_memory(100, 8);
+	ASSERT_NE(pA, nullptr);
+	ASSERT_NE(pB, nullptr);
+	ASSERT_NE(pC, nullptr);
+
+	// Headers raise the alignment to at least 8.
+	EXPECT_EQ((uintptr_t)pA % 64, 0);
+	EXPECT_EQ((uintptr_t)pB % 8, 0);
+	EXPECT_EQ(handler.usable_size(pA), 100);
+	EXPECT_EQ(handler.usable_size(pB), 100);
+
+	// Freeing without sizes reclaims the headers and padding too, so all three
+	// merge into one block starting at the arena.
+	EXPECT_EQ(handler.free_memory(pA), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(pC), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(pB), ErrorCode::Success);
+	ASSERT_EQ(get_free_block_count(), 1);
+	EXPECT_EQ(get_free_block(0).ptr, handler.arenas[0].mem_block);
+	EXPECT_EQ((uintptr_t)get_free_block(0).ptr + get_free_block(0).size,
+		(uintptr_t)handler.arenas[0].untouched_mem);
+}
+
+TEST_F(ArenaHandlerTest, SizelessFree_SmallRemainderBecomesUsable)
+{
+	handler.track_allocation_sizes = true;
+
+	void* ptr = handler.request_memory(1000, 8);
+	void* barrier = handler.request_memory(8, 8);
+	ASSERT_NE(barrier, nullptr);
+	EXPECT_EQ(handler.free_memory(ptr), ErrorCode::Success);
+
+	// The 200 byte remainder is too small to keep as a free block, so it is
+	// handed out as part of the allocation instead of leaking.
+	void* ptr2 = handler.request_memory(800, 8);
+	EXPECT_EQ(ptr2, ptr);
+	EXPECT_EQ(get_free_block_count(), 0);
+	EXPECT_EQ(handler.usable_size(ptr2), 1000);
+
+	// The sized free still works, and covers the whole region.
+	EXPECT_EQ(handler.free_memory(ptr2, 800), ErrorCode::Success);
+	EXPECT_EQ(get_free_block_count(), 1);
+	EXPECT_EQ(get_free_block(0).size, 1008);
+}
+
+TEST_F(TlsfArenaHandlerTest, SizelessFreeAndUsableSize)
+{
+	void* ptr = handler.request_memory(100, 8);
+	ASSERT_NE(ptr, nullptr);
+	EXPECT_GE(handler.usable_size(ptr), 100);
+	EXPECT_EQ(handler.free_memory(ptr), ErrorCode::Success);
+	EXPECT_EQ(handler.request_memory(100, 8), ptr);
+}
+
+TEST_F(ArenaHandlerTest, Padding_ReclaimedFromArena)
+{
+	// Push the arena's untouched pointer one byte past a 128 byte boundary.
+	int8_t* untouched = bump_to_offset(128, 1);
+
+	// 127 bytes of padding are skipped, which is enough to track.
+	void* aligned = handler.request_memory(1000, 128);
+	ASSERT_NE(aligned, nullptr);
+	EXPECT_EQ((int8_t*)aligned, untouched + 127);
+	EXPECT_EQ(handler.stats.padding_bytes_reclaimed, 127);
+	EXPECT_EQ(handler.stats.padding_bytes_lost, 0);
+
+	ASSERT_EQ(get_free_block_count(), 1);
+	EXPECT_EQ(get_free_block(0).ptr, untouched);
+
+	// A later small request is served from the padding.
+	void* small = handler.request_memory(16, 1);
+	EXPECT_EQ(small, untouched);
+}
+
+TEST_F(ArenaHandlerTest, Padding_ReclaimedFromFreeBlock)
+{
+	int8_t* start = bump_to_offset(128, 1);
+	void* block = handler.request_memory(4096, 1);
+	void* barrier = handler.request_memory(1, 1);
+	ASSERT_EQ(block, start);
+	ASSERT_NE(barrier, nullptr);
+	EXPECT_EQ(handler.free_memory(block, 4096), ErrorCode::Success);
+
+	void* aligned = handler.request_memory(1000, 128);
+	ASSERT_NE(aligned, nullptr);
+	EXPECT_EQ((int8_t*)aligned, start + 127);
+
+	// The block splits into the padding in front and the remainder behind.
+	ASSERT_EQ(get_free_block_count(), 2);
+	EXPECT_EQ(get_free_block(0).ptr, block);
+	EXPECT_EQ(get_free_block(0).size, 127);
+	EXPECT_EQ(get_free_block(1).ptr, (int8_t*)aligned + 1000);
+	EXPECT_EQ(handler.stats.padding_bytes_lost, 0);
+}
+
+TEST_F(ArenaHandlerTest, Padding_TooSmallIsCounted)
+{
+	void* first = handler.request_memory(1, 1);
+	ASSERT_NE(first, nullptr);
+
+	void* aligned = handler.request_memory(64, 8);
+	ASSERT_NE(aligned, nullptr);
+
+	// At most 7 bytes of padding can't hold a record.
+	const size_t padding = (uintptr_t)aligned - ((uintptr_t)first + 1);
+	EXPECT_EQ(handler.stats.padding_bytes_lost, padding);
+	EXPECT_EQ(handler.stats.padding_bytes_reclaimed, 0);
+	EXPECT_EQ(get_free_block_count(), 0);
+}
+
+TEST_F(ArenaHandlerTest, Sliver_RemainderReusedBySmallRequest)
+{
+	void* block = handler.request_memory(4096, 1);
+	void* barrier = handler.request_memory(1, 1);
+	ASSERT_NE(barrier, nullptr);
+	EXPECT_EQ(handler.free_memory(block, 4096), ErrorCode::Success);
+
+	// The 96 byte remainder is binned rather than kept as a free block.
+	void* large = handler.request_memory(4000, 1);
+	EXPECT_EQ(large, block);
+	EXPECT_EQ(get_free_block_count(), 0);
+	EXPECT_EQ(handler.stats.sliver_bytes, 96);
+
+	void* small = handler.request_memory(64, 1);
+	EXPECT_EQ(small, (int8_t*)block + 4000);
+	EXPECT_EQ(handler.stats.sliver_bytes, 32);
+	EXPECT_EQ(handler.stats.dropped_bytes, 0);
+}
+
+TEST_F(ArenaHandlerTest, Sliver_ConsolidatedWithFreedNeighbours)
+{
+	void* first = handler.request_memory(4096, 1, false);
+	void* second = handler.request_memory(4096, 1);
+	void* barrier = handler.request_memory(4095, 1);
+	ASSERT_NE(barrier, nullptr);
+	ASSERT_EQ(get_arena_count(), 1);
+	EXPECT_EQ(handler.free_memory(first, 4096), ErrorCode::Success);
+
+	void* reused = handler.request_memory(4000, 1);
+	EXPECT_EQ(reused, first);
+	EXPECT_EQ(handler.stats.sliver_bytes, 96);
+
+	// The sliver now sits between two free blocks it isn't merged with yet.
+	EXPECT_EQ(handler.free_memory(reused, 4000), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(second, 4096), ErrorCode::Success);
+	EXPECT_EQ(get_free_block_count(), 2);
+
+	// Nothing fits without consolidating, which happens before a new arena.
+	void* merged = handler.request_memory(8192, 1);
+	EXPECT_EQ(merged, first);
+	EXPECT_EQ(get_arena_count(), 1);
+	EXPECT_EQ(get_free_block_count(), 0);
+	EXPECT_EQ(handler.stats.sliver_bytes, 0);
+}
+
+TEST_F(ArenaHandlerTest, Sliver_ThresholdIsTunable)
+{
+	handler.min_free_block_size = 64;
+
+	void* block = handler.request_memory(4096, 1);
+	void* barrier = handler.request_memory(1, 1);
+	ASSERT_NE(barrier, nullptr);
+	EXPECT_EQ(handler.free_memory(block, 4096), ErrorCode::Success);
+
+	EXPECT_EQ(handler.request_memory(4000, 1), block);
+	ASSERT_EQ(get_free_block_count(), 1);
+	EXPECT_EQ(get_free_block(0).ptr, (int8_t*)block + 4000);
+	EXPECT_EQ(get_free_block(0).size, 96);
+	EXPECT_EQ(handler.stats.sliver_bytes, 0);
+}
+
+TEST_F(ArenaHandlerTest, Sliver_ThresholdBelowRecordSize)
+{
+	// Remainders too small for a free block record are binned, whatever the
+	// threshold says.
+	handler.min_free_block_size = 16;
+
+	void* block = handler.request_memory(1000, 1);
+	void* barrier = handler.request_memory(1, 1);
+	ASSERT_NE(barrier, nullptr);
+	EXPECT_EQ(handler.free_memory(block, 1000), ErrorCode::Success);
+
+	EXPECT_EQ(handler.request_memory(960, 1), block);
+	EXPECT_EQ(get_free_block_count(), 0);
+	EXPECT_EQ(handler.stats.sliver_bytes, 40);
+
+	void* next = handler.request_memory(200, 8);
+	ASSERT_NE(next, nullptr);
+	EXPECT_EQ(handler.free_memory(next, 200), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(block, 960), ErrorCode::Success);
+}
+
+TEST_F(ArenaHandlerTest, Arena_LiveBytesDetectsFullyFreeArena)
+{
+	void* pA = handler.request_memory(100, 8);
+	void* pB = handler.request_memory(300, 8);
+	ASSERT_EQ(get_arena_count(), 1);
+	EXPECT_EQ(handler.arenas[0].live_bytes, 400);
+
+	EXPECT_EQ(handler.free_memory(pA, 100), ErrorCode::Success);
+	EXPECT_EQ(handler.arenas[0].live_bytes, 300);
+
+	// Reusing freed memory counts it as live again.
+	void* pC = handler.request_memory(64, 8);
+	EXPECT_EQ(pC, pA);
+	EXPECT_EQ(handler.arenas[0].live_bytes, 364);
+
+	EXPECT_EQ(handler.free_memory(pB, 300), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(pC, 64), ErrorCode::Success);
+	EXPECT_EQ(handler.arenas[0].live_bytes, 0);
+}
+
+TEST_F(ArenaHandlerTest, Arena_FreeBlocksStayWithinTheirArena)
+{
+	void* pA = handler.request_memory(1000, 8, false);
+	void* pB = handler.request_memory(5000, 8, false);
+	ASSERT_EQ(get_arena_count(), 2);
+
+	EXPECT_EQ(handler.free_memory(pA, 1000), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(pB, 5000), ErrorCode::Success);
+
+	// Each arena tracks its own free block, whatever the arenas' addresses.
+	ASSERT_NE(handler.arenas[0].free_block_root, nullptr);
+	ASSERT_NE(handler.arenas[1].free_block_root, nullptr);
+	EXPECT_EQ(handler.arenas[0].free_block_root->ptr, pA);
+	EXPECT_EQ(handler.arenas[0].free_block_root->arena_index, 0);
+	EXPECT_EQ(handler.arenas[1].free_block_root->ptr, pB);
+	EXPECT_EQ(handler.arenas[1].free_block_root->arena_index, 1);
+	EXPECT_EQ(handler.arenas[0].live_bytes, 0);
+	EXPECT_EQ(handler.arenas[1].live_bytes, 0);
+}
+
+TEST_F(TlsfArenaHandlerTest, LiveBytesPerArena)
+{
+	void* ptr = handler.request_memory(1000, 8);
+	ASSERT_NE(ptr, nullptr);
+	EXPECT_GE(handler.arenas[0].live_bytes, 1000);
+
+	EXPECT_EQ(handler.free_memory(ptr), ErrorCode::Success);
+	EXPECT_EQ(handler.arenas[0].live_bytes, 0);
+}
+
+TEST_F(ArenaHandlerTest, BatchFree_MergesContiguousRuns)
+{
+	constexpr int num_blocks = 300;
+	constexpr int kept = 100;
+	void* ptrs[num_blocks];
+	for (int i = 0; i < num_blocks; ++i)
+	{
+		ptrs[i] = handler.request_memory(64, 8);
+	}
+
+	void* barrier = handler.request_memory(8, 8);
+	ASSERT_NE(barrier, nullptr);
+
+	// Free everything but one allocation, in reverse address order.
+	FreeRequest requests[num_blocks - 1];
+	int count = 0;
+	for (int i = num_blocks - 1; i >= 0; --i)
+	{
+		if (i != kept)
+		{
+			requests[count++] = {ptrs[i], 64};
+		}
+	}
+
+	EXPECT_EQ(handler.free_memory_batch(requests, count), ErrorCode::Success);
+	EXPECT_EQ(requests[0].ptr, ptrs[0]);
+	EXPECT_EQ(requests[count - 1].ptr, ptrs[num_blocks - 1]);
+
+	// The two runs either side of the kept allocation became one block each.
+	ASSERT_EQ(get_free_block_count(), 2);
+	EXPECT_EQ(get_free_block(0).size, kept * 64);
+	EXPECT_EQ(get_free_block(1).size, (num_blocks - kept - 1) * 64);
+	EXPECT_EQ(handler.arenas[0].live_bytes, 64 + 8);
+
+	EXPECT_EQ(handler.free_memory(ptrs[kept], 64), ErrorCode::Success);
+	ASSERT_EQ(get_free_block_count(), 1);
+	EXPECT_EQ(get_free_block(0).size, num_blocks * 64);
+	EXPECT_EQ(handler.arenas[0].live_bytes, 8);
+}
+
+TEST_F(ArenaHandlerTest, BatchFree_TrackedAllocations)
+{
+	handler.track_allocation_sizes = true;
+
+	FreeRequest requests[3];
+	requests[0] = {handler.request_memory(100, 8), 0};
+	requests[1] = {handler.request_memory(200, 32), 0};
+	requests[2] = {handler.request_memory(300, 8), 0};
+	void* barrier = handler.request_memory(8, 8);
+	ASSERT_NE(barrier, nullptr);
+
+	// Sizes are read from the headers, padding included.
+	EXPECT_EQ(handler.free_memory_batch(requests, 3), ErrorCode::Success);
+	ASSERT_EQ(get_free_block_count(), 1);
+	EXPECT_EQ(get_free_block(0).ptr, handler.arenas[0].mem_block);
+
+	EXPECT_EQ(handler.free_memory(barrier), ErrorCode::Success);
+	EXPECT_EQ(handler.arenas[0].live_bytes, 0);
+}
+
+TEST_F(ArenaHandlerTest, BatchRequest_CarvesContiguousBlocks)
+{
+	void* ptrs[100];
+	ASSERT_EQ(handler.request_memory_batch(100, 48, 16, ptrs), ErrorCode::Success);
+	ASSERT_EQ(get_arena_count(), 1);
+	for (int i = 0; i < 100; ++i)
+	{
+		EXPECT_EQ((uintptr_t)ptrs[i] % 16, 0);
+		EXPECT_EQ(ptrs[i], (int8_t*)ptrs[0] + i * 48);
+	}
+
+	EXPECT_EQ(handler.arenas[0].live_bytes, 100 * 48);
+}
+
+TEST_F(ArenaHandlerTest, BatchRequest_FreeBlockThenArena)
+{
+	void* block = handler.request_memory(1000, 8);
+	void* barrier = handler.request_memory(8, 8);
+	ASSERT_NE(barrier, nullptr);
+	EXPECT_EQ(handler.free_memory(block, 1000), ErrorCode::Success);
+
+	// Ten blocks fill the free block, leaving a sliver; the rest come from the
+	// arena's untouched memory.
+	void* ptrs[15];
+	ASSERT_EQ(handler.request_memory_batch(15, 96, 8, ptrs), ErrorCode::Success);
+	for (int i = 0; i < 10; ++i)
+	{
+		EXPECT_EQ(ptrs[i], (int8_t*)block + i * 96);
+	}
+
+	EXPECT_GT((uintptr_t)ptrs[10], (uintptr_t)barrier);
+	EXPECT_EQ(get_free_block_count(), 0);
+	EXPECT_EQ(handler.stats.sliver_bytes, 40);
+}
+
+TEST_F(ArenaHandlerTest, BatchRequest_TrackedAllocations)
+{
+	handler.track_allocation_sizes = true;
+
+	void* ptrs[10];
+	ASSERT_EQ(handler.request_memory_batch(10, 100, 32, ptrs), ErrorCode::Success);
+	for (int i = 0; i < 10; ++i)
+	{
+		EXPECT_EQ((uintptr_t)ptrs[i] % 32, 0);
+		EXPECT_GE(handler.usable_size(ptrs[i]), 100);
+		EXPECT_EQ(handler.free_memory(ptrs[i]), ErrorCode::Success);
+	}
+
+	EXPECT_EQ(handler.arenas[0].live_bytes, 0);
+	EXPECT_EQ(handler.request_memory_batch(1, 0, 8, ptrs), ErrorCode::InvalidArgument);
+}
+
+TEST_F(TlsfArenaHandlerTest, BatchRequest)
+{
+	void* ptrs[10];
+	ASSERT_EQ(handler.request_memory_batch(10, 100, 32, ptrs), ErrorCode::Success);
+	for (int i = 0; i < 10; ++i)
+	{
+		EXPECT_EQ((uintptr_t)ptrs[i] % 32, 0);
+		EXPECT_EQ(handler.free_memory(ptrs[i]), ErrorCode::Success);
+	}
+
+	EXPECT_EQ(handler.request_memory_batch(1, 0, 8, ptrs), ErrorCode::InvalidArgument);
+}
+
+TEST_F(ArenaHandlerTest, Arena_ExhaustedArenaIsRetired)
+{
+	void* pA = handler.request_memory(1000, 1, false);
+	void* pB = handler.request_memory(1900, 1);
+	ASSERT_NE(pB, nullptr);
+	ASSERT_EQ(get_arena_count(), 1);
+
+	// The 100 bytes left can't serve the request, so the arena is retired and its
+	// tail becomes a free block.
+	void* pC = handler.request_memory(500, 1, false);
+	ASSERT_NE(pC, nullptr);
+	EXPECT_EQ(get_arena_count(), 2);
+	EXPECT_EQ(handler.current_arena, 1);
+	EXPECT_EQ(handler.arenas[0].untouched_mem, handler.arenas[0].mem_block + 3000);
+	ASSERT_EQ(get_free_block_count(), 1);
+	EXPECT_EQ(get_free_block(0).ptr, (int8_t*)pA + 2900);
+	EXPECT_EQ(get_free_block(0).size, 100);
+}
+
+TEST_F(ArenaHandlerTest, Arena_RoomyArenaStaysOpen)
+{
+	void* pA = handler.request_memory(5000, 1, false);
+	void* pB = handler.request_memory(5000, 1);
+	ASSERT_NE(pA, nullptr);
+	ASSERT_NE(pB, nullptr);
+
+	// 5000 bytes are left, above the retire threshold, so the arena stays open
+	// while the new one becomes current.
+	void* pC = handler.request_memory(6000, 1, false);
+	ASSERT_NE(pC, nullptr);
+	EXPECT_EQ(get_arena_count(), 2);
+	EXPECT_EQ(handler.arenas[0].untouched_mem, (int8_t*)pB + 5000);
+	EXPECT_EQ(handler.current_arena, 1);
+
+	// Once the current arena runs short, the older one serves the request and
+	// becomes current.
+	void* pD = handler.request_memory(11000, 1);
+	void* pE = handler.request_memory(4500, 1);
+	ASSERT_NE(pD, nullptr);
+	EXPECT_EQ(pE, (int8_t*)pB + 5000);
+	EXPECT_EQ(handler.current_arena, 0);
+	EXPECT_EQ(get_arena_count(), 2);
+}
+
+TEST_F(ArenaHandlerTest, ArenaSpace_MissJumpsToArenaWithRoom)
+{
+	void* pA = handler.request_memory(10000, 1, false);
+	void* pB = handler.request_memory(25000, 1, false);
+	void* pC = handler.request_memory(48000, 1);
+	ASSERT_NE(pA, nullptr);
+	ASSERT_NE(pC, nullptr);
+	ASSERT_EQ(get_arena_count(), 2);
+	EXPECT_EQ(handler.current_arena, 1);
+	EXPECT_EQ(pC, (int8_t*)pB + 25000);
+
+	// The current arena can't fit the request; the tree points at the first one
+	// instead of a new arena being created.
+	void* pD = handler.request_memory(15000, 1);
+	EXPECT_EQ(pD, (int8_t*)pA + 10000);
+	EXPECT_EQ(get_arena_count(), 2);
+	EXPECT_EQ(handler.current_arena, 0);
+	EXPECT_EQ(handler.arena_space[1], 5000);
+}
+
+TEST_F(ArenaHandlerTest, ArenaSpace_TracksManyArenas)
+{
+	// Each request is larger than any arena's room, forcing a new arena.
+	size_t size = 100;
+	for (int i = 0; i < 10; ++i)
+	{
+		ASSERT_NE(handler.request_memory(size, 1, false), nullptr);
+		size *= 3;
+	}
+
+	ASSERT_EQ(get_arena_count(), 10);
+	EXPECT_GE(handler.arena_space_leaves, 10);
+
+	// Leaves may overstate an arena's room, but never understate it.
+	for (uint16_t i = 0; i < 10; ++i)
+	{
+		const MemoryArena& arena = handler.arenas[i];
+		EXPECT_GE(handler.arena_space[handler.arena_space_leaves + i],
+			(size_t)(arena.mem_block + arena.size - arena.untouched_mem));
+	}
+
+	// Bumping the current arena leaves its leaf stale until a miss refreshes it.
+	const size_t newest_size = handler.arenas[9].size;
+	EXPECT_EQ(handler.arena_space[1], newest_size);
+	ASSERT_NE(handler.request_memory(newest_size, 1), nullptr);
+	EXPECT_EQ(handler.arena_space[handler.arena_space_leaves + 9], newest_size * 2 / 3);
+}
+
+TEST_F(ArenaHandlerTest, Backing_MmapArenasAreHugePageAligned)
+{
+	handler.arena_backing = ArenaBacking::Mmap;
+
+	void* ptr = handler.request_memory(100, 8);
+	ASSERT_NE(ptr, nullptr);
+	memset(ptr, 0xab, 100);
+
+	const MemoryArena& arena = handler.arenas[0];
+	constexpr size_t huge_page_size = 1 << 21;
+	EXPECT_EQ((uintptr_t)arena.mem_block % huge_page_size, 0);
+	EXPECT_EQ(arena.size % huge_page_size, 0);
+	EXPECT_GE(arena.size, 1 << 20);
+
+	// Mapped arenas behave like any other.
+	EXPECT_EQ(handler.free_memory(ptr, 100), ErrorCode::Success);
+	EXPECT_EQ(handler.request_memory(100, 8), ptr);
+}
+
+TEST_F(ArenaHandlerTest, Backing_HugeTlbFallsBackToMmap)
+{
+	handler.arena_backing = ArenaBacking::MmapHugeTlb;
+
+	void* ptr = handler.request_memory(3 << 20, 8, false);
+	ASSERT_NE(ptr, nullptr);
+	memset(ptr, 0xcd, 3 << 20);
+
+	// Without a reserved huge page pool, the arena is still mapped.
+	EXPECT_NE(handler.arenas[0].backing, ArenaBacking::Malloc);
+	EXPECT_EQ(handler.arenas[0].size % (1 << 21), 0);
+	EXPECT_GE(handler.arenas[0].size, (size_t)9 << 20);
+}
+
+TEST_F(ArenaHandlerTest, Reserved_CommitsAsTheBumpPointerAdvances)
+{
+	handler.arena_backing = ArenaBacking::Reserved;
+	handler.reservation_size = 64 << 20;
+
+	void* small = handler.request_memory(100, 8);
+	ASSERT_NE(small, nullptr);
+	ASSERT_EQ(get_arena_count(), 1);
+
+	const MemoryArena& arena = handler.arenas[0];
+	EXPECT_EQ(arena.backing, ArenaBacking::Reserved);
+	EXPECT_EQ(arena.size, (size_t)64 << 20);
+	EXPECT_EQ(arena.committed_end - arena.mem_block, 2 << 20);
+
+	// A larger request commits just enough whole steps to cover it.
+	void* large = handler.request_memory(5 << 20, 8);
+	ASSERT_NE(large, nullptr);
+	memset(large, 0xab, 5 << 20);
+	EXPECT_EQ(handler.arenas[0].committed_end - handler.arenas[0].mem_block, 6 << 20);
+	EXPECT_EQ(get_arena_count(), 1);
+}
+
+TEST_F(ArenaHandlerTest, Reserved_ExhaustedReservationFails)
+{
+	handler.arena_backing = ArenaBacking::Reserved;
+	handler.reservation_size = 8 << 20;
+
+	void* first = handler.request_memory(6 << 20, 8);
+	ASSERT_NE(first, nullptr);
+
+	// No second arena is created once the reservation can't fit a request.
+	EXPECT_EQ(handler.request_memory(4 << 20, 8), nullptr);
+	EXPECT_EQ(get_arena_count(), 1);
+
+	// Freed memory is reused as usual.
+	EXPECT_EQ(handler.free_memory(first, 6 << 20), ErrorCode::Success);
+	EXPECT_EQ(handler.request_memory(4 << 20, 8), first);
+}
+
+#ifdef __linux__
+TEST_F(ArenaHandlerTest, Reserved_CommitFailureFailsTheRequest)
+{
+	handler.arena_backing = ArenaBacking::Reserved;
+	handler.reservation_size = 64 << 20;
+
+	void* first = handler.request_memory(100, 8);
+	ASSERT_NE(first, nullptr);
+
+	// Requests past the committed memory fail instead of retrying the arena.
+	fail_commits = true;
+	EXPECT_EQ(handler.request_memory(4 << 20, 8), nullptr);
+	void* ptrs[4] = {};
+	EXPECT_EQ(handler.request_memory_batch(4, 1 << 20, 8, ptrs),
+		ErrorCode::OutOfMemory);
+	fail_commits = false;
+
+	EXPECT_EQ(handler.arenas[0].live_bytes, 100);
+	EXPECT_EQ(get_arena_count(), 1);
+
+	// The reservation is still usable once memory can be committed.
+	void* large = handler.request_memory(4 << 20, 8);
+	ASSERT_NE(large, nullptr);
+	memset(large, 0xab, 4 << 20);
+	EXPECT_EQ(handler.request_memory_batch(4, 1 << 20, 8, ptrs), ErrorCode::Success);
+}
+#endif
+
+TEST_F(ArenaHandlerTest, Release_FreeArenasWaitForDecay)
+{
+	void* pA = handler.request_memory(1000, 8, false);
+	void* pB = handler.request_memory(5000, 8, false);
+	ASSERT_EQ(get_arena_count(), 2);
+
+	// Both arenas are fully free, but haven't been for long enough.
+	EXPECT_EQ(handler.free_memory(pA, 1000), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(pB, 5000), ErrorCode::Success);
+	EXPECT_EQ(handler.stats.arenas_released, 0);
+
+	const size_t total_size = handler.arenas[0].size + handler.arenas[1].size;
+	EXPECT_EQ(handler.trim(), total_size);
+	EXPECT_EQ(handler.stats.arenas_released, 2);
+	EXPECT_EQ(handler.released_arenas_len, 2);
+	EXPECT_EQ(get_free_block_count(), 0);
+	EXPECT_EQ(handler.arenas[0].mem_block, nullptr);
+
+	// Released slots are reused before the arena array grows.
+	void* pC = handler.request_memory(100, 8);
+	ASSERT_NE(pC, nullptr);
+	EXPECT_EQ(get_arena_count(), 2);
+	EXPECT_EQ(handler.released_arenas_len, 1);
+	EXPECT_EQ(handler.free_memory(pC, 100), ErrorCode::Success);
+}
+
+TEST_F(ArenaHandlerTest, Release_DecayedArenasGoWithoutAnotherEmptying)
+{
+	handler.arena_decay_ms = 20;
+	handler.retained_free_arenas = 0;
+	handler.request_growth_factor = 1;
+
+	void* pA = handler.request_memory(1000, 8, false);
+	void* live = handler.request_memory(100, 8);
+	void* blocks[2 * RELEASE_CHECK_INTERVAL] = {};
+	for (void*& block : blocks)
+	{
+		block = handler.request_memory(64, 8);
+		ASSERT_NE(block, nullptr);
+	}
+
+	ASSERT_EQ(get_arena_count(), 2);
+	EXPECT_EQ(handler.free_memory(pA, 1000), ErrorCode::Success);
+	EXPECT_EQ(handler.stats.arenas_released, 0);
+	EXPECT_NE(handler.release_due_ms, 0);
+
+	// Frees that leave their arena in use release the other arena once its decay
+	// has run out, at the next check.
+	for (uint32_t ii = 0; ii < RELEASE_CHECK_INTERVAL; ii++)
+	{
+		EXPECT_EQ(handler.free_memory(blocks[ii], 64), ErrorCode::Success);
+	}
+
+	EXPECT_EQ(handler.stats.arenas_released, 0);
+	std::this_thread::sleep_for(std::chrono::milliseconds(30));
+	for (uint32_t ii = RELEASE_CHECK_INTERVAL; ii < 2 * RELEASE_CHECK_INTERVAL; ii++)
+	{
+		EXPECT_EQ(handler.free_memory(blocks[ii], 64), ErrorCode::Success);
+	}
+
+	EXPECT_EQ(handler.stats.arenas_released, 1);
+	EXPECT_EQ(handler.release_due_ms, 0);
+	EXPECT_EQ(handler.free_memory(live, 100), ErrorCode::Success);
+}
+
+TEST_F(ArenaHandlerTest, Release_RetainsConfiguredFreeArenas)
+{
+	handler.arena_decay_ms = 0;
+	handler.retained_free_arenas = 1;
+
+	void* pA = handler.request_memory(1000, 8, false);
+	void* pB = handler.request_memory(5000, 8, false);
+	void* pC = handler.request_memory(20000, 8, false);
+	void* barrier = handler.request_memory(100, 8);
+	ASSERT_EQ(get_arena_count(), 3);
+	EXPECT_EQ(handler.free_memory(barrier, 100), ErrorCode::Success);
+
+	// The most recently freed arena is kept for the next spike.
+	EXPECT_EQ(handler.free_memory(pA, 1000), ErrorCode::Success);
+	EXPECT_EQ(handler.stats.arenas_released, 0);
+	EXPECT_EQ(handler.free_memory(pB, 5000), ErrorCode::Success);
+	EXPECT_EQ(handler.stats.arenas_released, 1);
+	EXPECT_EQ(handler.free_memory(pC, 20000), ErrorCode::Success);
+	EXPECT_EQ(handler.stats.arenas_released, 2);
+	EXPECT_NE(handler.arenas[2].mem_block, nullptr);
+
+	// Lookups skip the released arenas.
+	void* pD = handler.request_memory(100, 8);
+	EXPECT_EQ(pD, handler.arenas[2].mem_block);
+	EXPECT_EQ(handler.free_memory(pD, 100), ErrorCode::Success);
+}
+
+TEST_F(ArenaHandlerTest, Release_ReservedArenaIsDecommitted)
+{
+	handler.arena_backing = ArenaBacking::Reserved;
+	handler.reservation_size = 64 << 20;
+
+	void* ptr = handler.request_memory(5 << 20, 8);
+	ASSERT_NE(ptr, nullptr);
+	EXPECT_EQ(handler.free_memory(ptr, 5 << 20), ErrorCode::Success);
+	EXPECT_EQ(handler.trim(), (size_t)6 << 20);
+
+	const MemoryArena& arena = handler.arenas[0];
+	EXPECT_EQ(arena.committed_end, arena.mem_block);
+	EXPECT_EQ(arena.untouched_mem, arena.mem_block);
+
+	// The reservation is committed again on demand.
+	void* again = handler.request_memory(100, 8);
+	EXPECT_EQ(again, handler.arenas[0].mem_block);
+	memset(again, 0xab, 100);
+}
+
+TEST_F(TlsfArenaHandlerTest, ReleaseFreePools)
+{
+	void* pA = handler.request_memory(1000, 8, false);
+	void* pB = handler.request_memory(5000, 8, false);
+	ASSERT_EQ(handler.ds_info.arenas_len, 2);
+
+	EXPECT_EQ(handler.free_memory(pA), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(pB), ErrorCode::Success);
+	EXPECT_GT(handler.trim(), 0);
+	EXPECT_EQ(handler.released_arenas_len, 2);
+
+	// TLSF no longer hands out memory from the released pools.
+	void* pC = handler.request_memory(1000, 8);
+	ASSERT_NE(pC, nullptr);
+	EXPECT_EQ(handler.free_memory(pC), ErrorCode::Success);
+}
+
+TEST_F(TlsfArenaHandlerTest, FreesLeaveReleaseToTheSlowPath)
+{
+	handler.retained_free_arenas = 0;
+	handler.arena_decay_ms = 0;
+
+	void* pA = handler.request_memory(1000, 8, false);
+	void* pB = handler.request_memory(5000, 8, false);
+	ASSERT_EQ(handler.ds_info.arenas_len, 2);
+
+	// The free only timestamps the emptied pool.
+	EXPECT_EQ(handler.free_memory(pA), ErrorCode::Success);
+	EXPECT_EQ(handler.stats.bytes_released, 0);
+
+	// A request that needs a new arena releases it first.
+	void* pC = handler.request_memory(100000, 8, false);
+	ASSERT_NE(pC, nullptr);
+	EXPECT_GT(handler.stats.bytes_released, 0);
+
+	EXPECT_EQ(handler.free_memory(pB), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(pC), ErrorCode::Success);
+}
+
+TEST_F(ArenaHandlerTest, Purge_LargeFreeBlocksOnly)
+{
+	handler.arena_backing = ArenaBacking::Mmap;
+
+	void* large = handler.request_memory(256 << 10, 8);
+	void* barrier = handler.request_memory(8, 8);
+	void* small = handler.request_memory(4096, 8);
+	void* barrier2 = handler.request_memory(8, 8);
+	ASSERT_NE(barrier, nullptr);
+	ASSERT_NE(barrier2, nullptr);
+	memset(large, 0xab, 256 << 10);
+	EXPECT_EQ(handler.free_memory(large, 256 << 10), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(small, 4096), ErrorCode::Success);
+	ASSERT_EQ(get_free_block_count(), 2);
+
+	// Whole pages short of the record are purged; the small block is left alone.
+	const size_t purged = handler.purge_free_blocks();
+	EXPECT_GT(purged, (size_t)240 << 10);
+	EXPECT_LT(purged, (size_t)256 << 10);
+	EXPECT_EQ(handler.stats.bytes_purged, purged);
+	EXPECT_TRUE(get_free_block(0).purged);
+	EXPECT_FALSE(get_free_block(1).purged);
+
+	// Purged blocks aren't purged again, and their memory stays usable.
+	EXPECT_EQ(handler.purge_free_blocks(), 0);
+	void* reused = handler.request_memory(128 << 10, 8);
+	EXPECT_EQ(reused, large);
+	memset(reused, 0xcd, 128 << 10);
+	EXPECT_TRUE(get_free_block(0).purged);
+}
+
+TEST_F(ArenaHandlerTest, Purge_MergeClearsFlag)
+{
+	void* pA = handler.request_memory(4096, 8);
+	void* pB = handler.request_memory(256 << 10, 8);
+	void* barrier = handler.request_memory(8, 8);
+	ASSERT_NE(barrier, nullptr);
+	EXPECT_EQ(handler.free_memory(pB, 256 << 10), ErrorCode::Success);
+	handler.purge_free_blocks();
+	ASSERT_TRUE(get_free_block(0).purged);
+
+	// The merged block holds unpurged memory, so it is no longer marked purged.
+	EXPECT_EQ(handler.free_memory(pA, 4096), ErrorCode::Success);
+	ASSERT_EQ(get_free_block_count(), 1);
+	EXPECT_FALSE(get_free_block(0).purged);
+}
+
+TEST_F(TlsfArenaHandlerTest, PurgeIsUnsupported)
+{
+	void* ptr = handler.request_memory(256 << 10, 8);
+	EXPECT_EQ(handler.free_memory(ptr), ErrorCode::Success);
+	EXPECT_EQ(handler.purge_free_blocks(), 0);
+}
+
+TEST(ArenaHandlerConfigTest, SizesArenasFromConfig)
+{
+	ArenaHandlerConfig config;
+	config.arena_size = 64 << 10;
+	config.request_growth_factor = 2;
+	ArenaHandler handler(config);
+
+	// Small requests get a whole `arena_size` arena.
+	void* small = handler.request_memory(100, 8);
+	ASSERT_NE(small, nullptr);
+	ASSERT_EQ(handler.ds_info.arenas_len, 1);
+	EXPECT_EQ(handler.arenas[0].size, (size_t)64 << 10);
+
+	// Larger ones get `request_growth_factor` times the request.
+	void* large = handler.request_memory(100000, 8);
+	ASSERT_NE(large, nullptr);
+	ASSERT_EQ(handler.ds_info.arenas_len, 2);
+	EXPECT_EQ(handler.arenas[1].size, (size_t)200000);
+
+	// As do requests that skip the default allocation.
+	void* exact = handler.request_memory(150000, 8, false);
+	ASSERT_NE(exact, nullptr);
+	ASSERT_EQ(handler.ds_info.arenas_len, 3);
+	EXPECT_EQ(handler.arenas[2].size, (size_t)300000);
+}
+
+TEST(ArenaHandlerConfigTest, AppliesMetadataAndSliverSettings)
+{
+	ArenaHandlerConfig config;
+	config.initial_arenas_capacity = 1;
+	config.min_free_block_size = 1024;
+	config.mode = AllocationMode::SegregatedFit;
+	config.track_allocation_sizes = true;
+	ArenaHandler handler(config);
+	EXPECT_EQ(handler.min_free_block_size, 1024);
+	EXPECT_TRUE(handler.track_allocation_sizes);
+
+	void* ptr = handler.request_memory(100, 8);
+	ASSERT_NE(ptr, nullptr);
+	EXPECT_EQ(handler.ds_info.arenas_capacity, 1);
+
+	// The metadata arrays still grow past the initial capacity.
+	void* next = handler.request_memory(4 << 20, 8);
+	ASSERT_NE(next, nullptr);
+	EXPECT_EQ(handler.ds_info.arenas_capacity, 2);
+	EXPECT_EQ(handler.free_memory(ptr), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(next), ErrorCode::Success);
+}
+
+TEST(ArenaHandlerConfigTest, ClampsUnusableValues)
+{
+	ArenaHandlerConfig config;
+	config.arena_size = 0;
+	config.request_growth_factor = 0;
+	config.initial_arenas_capacity = 0;
+	config.min_free_block_size = 16;
+	ArenaHandler handler(config);
+	EXPECT_EQ(handler.arena_size, 1);
+	EXPECT_EQ(handler.request_growth_factor, 1);
+	EXPECT_EQ(handler.initial_arenas_capacity, 1);
+	EXPECT_EQ(handler.min_free_block_size, sizeof(FreeBlock));
+
+	void* ptr = handler.request_memory(100, 8);
+	ASSERT_NE(ptr, nullptr);
+	EXPECT_EQ(handler.arenas[0].size, 100);
+	EXPECT_EQ(handler.free_memory(ptr, 100), ErrorCode::Success);
+
+	// Splitting with the clamped threshold leaves the remainder reusable.
+	void* block = handler.request_memory(1000, 8, false);
+	void* barrier = handler.request_memory(1, 1, false);
+	ASSERT_NE(block, nullptr);
+	ASSERT_NE(barrier, nullptr);
+	EXPECT_EQ(handler.free_memory(block, 1000), ErrorCode::Success);
+	EXPECT_EQ(handler.request_memory(960, 8), block);
+
+	void* next = handler.request_memory(32, 8);
+	ASSERT_NE(next, nullptr);
+	EXPECT_EQ(handler.free_memory(next, 32), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(block, 960), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(barrier, 1), ErrorCode::Success);
+}
+
+TEST(ArenaHandlerConfigTest, ArenasGrowGeometrically)
+{
+	ArenaHandlerConfig config;
+	config.arena_size = 64 << 10;
+	config.request_growth_factor = 1;
+	config.arena_growth_factor = 2;
+	config.max_arena_size = 256 << 10;
+	ArenaHandler handler(config);
+
+	// Each arena fills up in one request, so the next has to be created.
+	const size_t expected[] = {64 << 10, 128 << 10, 256 << 10, 256 << 10};
+	void* ptrs[4];
+	for (size_t ii = 0; ii < 4; ii++)
+	{
+		ptrs[ii] = handler.request_memory(expected[ii], 8);
+		ASSERT_NE(ptrs[ii], nullptr);
+		ASSERT_EQ(handler.ds_info.arenas_len, ii + 1);
+		EXPECT_EQ(handler.arenas[ii].size, expected[ii]);
+	}
+
+	// Releasing arenas shrinks the next one back down.
+	handler.retained_free_arenas = 0;
+	handler.arena_decay_ms = 0;
+	for (size_t ii = 1; ii < 4; ii++)
+	{
+		EXPECT_EQ(handler.free_memory(ptrs[ii], expected[ii]), ErrorCode::Success);
+	}
+
+	ASSERT_EQ(handler.released_arenas_len, 3);
+	void* ptr = handler.request_memory(100, 8);
+	ASSERT_NE(ptr, nullptr);
+	EXPECT_EQ(handler.arenas[handler.current_arena].size, (size_t)128 << 10);
+}
+
+TEST(ArenaHandlerConfigTest, GrowthNeverShrinksBelowArenaSize)
+{
+	ArenaHandlerConfig config;
+	config.arena_size = 1 << 20;
+	config.request_growth_factor = 1;
+	config.max_arena_size = 64 << 10;
+	ArenaHandler handler(config);
+	for (size_t ii = 0; ii < 2; ii++)
+	{
+		ASSERT_NE(handler.request_memory(1 << 20, 8), nullptr);
+		ASSERT_EQ(handler.ds_info.arenas_len, ii + 1);
+		EXPECT_EQ(handler.arenas[ii].size, (size_t)1 << 20);
+	}
+}
+
+TEST(BasicArenaHandlerTest, DefaultInstantiationWrapsArenaHandler)
+{
+	static_assert(std::is_same_v<DefaultArenaHandler::Engine,
+		SegregatedFitPolicy::Engine<MallocBacking>>);
+	static_assert(sizeof(DefaultArenaHandler) == sizeof(DefaultArenaHandler::Engine));
+
+	DefaultArenaHandler handler;
+	void* ptr = handler.request_memory(100, 16);
+	ASSERT_NE(ptr, nullptr);
+	EXPECT_EQ((uintptr_t)ptr % 16, 0);
+	EXPECT_EQ(handler.engine.handler.ds_info.arenas_len, 1);
+	EXPECT_EQ(handler.free_memory(ptr, 100), ErrorCode::Success);
+	EXPECT_EQ(handler.engine.handler.ds_info.free_blocks_len, 1);
+}
+
+TEST(BasicArenaHandlerTest, PoliciesConfigureTheEngine)
+{
+	BasicArenaHandler<TlsfPolicy, MmapBacking, MutexLock, CountingStats> handler;
+	EXPECT_EQ(handler.engine.handler.mode, AllocationMode::Tlsf);
+	EXPECT_EQ(handler.engine.handler.arena_backing, ArenaBacking::Mmap);
+
+	void* first = handler.request_memory(100, 8);
+	void* second = handler.request_memory(200, 8);
+	ASSERT_NE(first, nullptr);
+	ASSERT_NE(second, nullptr);
+	EXPECT_EQ(handler.free_memory(first, 100), ErrorCode::Success);
+	EXPECT_EQ(handler.stats.requests, 2);
+	EXPECT_EQ(handler.stats.bytes_requested, 300);
+	EXPECT_EQ(handler.stats.frees, 1);
+	EXPECT_EQ(handler.stats.bytes_freed, 100);
+	EXPECT_EQ(handler.free_memory(second, 200), ErrorCode::Success);
+}
+
+TEST(BasicArenaHandlerTest, BumpPolicyBumpsAndNeverFrees)
+{
+	BumpArenaHandler handler;
+	handler.engine.arena_size = 4096;
+
+	uintptr_t prev_end = 0;
+	for (int ii = 0; ii < 8; ii++)
+	{
+		void* ptr = handler.request_memory(100, 32);
+		ASSERT_NE(ptr, nullptr);
+		EXPECT_EQ((uintptr_t)ptr % 32, 0);
+
+		// Allocations follow each other, skipping only alignment padding.
+		if (prev_end != 0)
+		{
+			EXPECT_GE((uintptr_t)ptr, prev_end);
+			EXPECT_LT((uintptr_t)ptr - prev_end, 32);
+		}
+
+		memset(ptr, 0xab, 100);
+		prev_end = (uintptr_t)ptr + 100;
+	}
+
+	// Freeing doesn't hand memory back.
+	void* last = (void*)(prev_end - 100);
+	EXPECT_EQ(handler.free_memory(last, 100), ErrorCode::Success);
+	EXPECT_NE(handler.request_memory(100, 32), last);
+}
+
+TEST(BasicArenaHandlerTest, BumpPolicyGrowsAndResets)
+{
+	BumpArenaHandler handler;
+	handler.engine.arena_size = 4096;
+
+	ASSERT_NE(handler.request_memory(1000, 8), nullptr);
+	const BumpPolicy::BumpChunk* first = handler.engine.chunk;
+	EXPECT_EQ(first->size, 4096);
+
+	// Overflowing the arena maps a larger one, and oversized requests fit.
+	ASSERT_NE(handler.request_memory(4000, 8), nullptr);
+	EXPECT_EQ(handler.engine.chunk->prev, first);
+	EXPECT_EQ(handler.engine.chunk->size, 8192);
+	void* large = handler.request_memory(100000, 64);
+	ASSERT_NE(large, nullptr);
+	EXPECT_EQ((uintptr_t)large % 64, 0);
+	memset(large, 0xcd, 100000);
+
+	handler.engine.reset();
+	EXPECT_EQ(handler.engine.chunk, nullptr);
+	ASSERT_NE(handler.request_memory(10, 8), nullptr);
+	EXPECT_EQ(handler.engine.chunk->size, 4096);
+}
+
+TEST(BasicArenaHandlerTest, AtomicBumpPolicyBumpsAndGrows)
+{
+	AtomicBumpArenaHandler handler;
+	handler.engine.arena_size = 4096;
+
+	void* first = handler.request_memory(100, 32);
+	void* second = handler.request_memory(100, 32);
+	ASSERT_NE(first, nullptr);
+	EXPECT_EQ((uintptr_t)first % 32, 0);
+	EXPECT_EQ((int8_t*)second, (int8_t*)first + 128);
+
+	// Exhausting the arena installs a larger one linked to it.
+	const AtomicBumpPolicy::AtomicBumpChunk* arena = handler.engine.chunk.load();
+	EXPECT_EQ(arena->size, 4096);
+	ASSERT_NE(handler.request_memory(4000, 8), nullptr);
+	EXPECT_EQ(handler.engine.chunk.load()->prev, arena);
+	EXPECT_EQ(handler.engine.chunk.load()->size, 8192);
+
+	EXPECT_EQ(handler.free_memory(first, 100), ErrorCode::Success);
+	handler.engine.reset();
+	EXPECT_EQ(handler.engine.chunk.load(), nullptr);
+	ASSERT_NE(handler.request_memory(10, 8), nullptr);
+	EXPECT_EQ(handler.engine.chunk.load()->size, 4096);
+}
+
+TEST(BasicArenaHandlerTest, AtomicBumpPolicyThreadsNeverOverlap)
+{
+	AtomicBumpArenaHandler handler;
+	handler.engine.arena_size = 4096;
+	handler.engine.max_arena_size = 1 << 16;
+
+	// Small arenas make threads race to install new ones as well as to bump.
+	constexpr int threads_len = 8;
+	constexpr int nodes_len = 20000;
+	bool failed[threads_len] = {};
+	std::thread threads[threads_len];
+	for (int tt = 0; tt < threads_len; tt++)
+	{
+		threads[tt] = std::thread([&handler, &failed, tt]() {
+			uint8_t** nodes = (uint8_t**)malloc(sizeof(uint8_t*) * nodes_len);
+			for (int ii = 0; ii < nodes_len; ii++)
+			{
+				const size_t size = 1 + ii % 48;
+				const uint8_t alignment = (uint8_t)(1 << (ii % 5));
+				nodes[ii] = (uint8_t*)handler.request_memory(size, alignment);
+				failed[tt] |= nodes[ii] == nullptr ||
+					(uintptr_t)nodes[ii] % alignment != 0;
+				if (nodes[ii] != nullptr)
+				{
+					memset(nodes[ii], tt, size);
+				}
+			}
+
+			for (int ii = 0; ii < nodes_len; ii++)
+			{
+				const size_t size = 1 + ii % 48;
+				for (size_t kk = 0; nodes[ii] != nullptr && kk < size; kk++)
+				{
+					failed[tt] |= nodes[ii][kk] != tt;
+				}
+			}
+
+			free(nodes);
+		});
+	}
+
+	for (int tt = 0; tt < threads_len; tt++)
+	{
+		threads[tt].join();
+		EXPECT_FALSE(failed[tt]) << "thread " << tt;
+	}
+}
+
+struct UpstreamLog
+{
+	size_t acquired = 0;
+	size_t released = 0;
+};
+
+static void* upstream_acquire(size_t size, void* user_data)
+{
+	((UpstreamLog*)user_data)->acquired++;
+	return malloc(size);
+}
+
+static void upstream_release(void* mem, size_t, void* user_data)
+{
+	((UpstreamLog*)user_data)->released++;
+	free(mem);
+}
+
+TEST(UpstreamTest, ArenasComeFromTheUpstreamAllocator)
+{
+	UpstreamLog log;
+	{
+		ArenaHandlerConfig config;
+		config.arena_backing = ArenaBacking::Upstream;
+		config.upstream = {upstream_acquire, upstream_release, &log};
+		config.retained_free_arenas = 0;
+		config.arena_decay_ms = 0;
+		ArenaHandler handler(config);
+
+		void* first = handler.request_memory(100, 8);
+		void* second = handler.request_memory(4 << 20, 8);
+		ASSERT_NE(first, nullptr);
+		ASSERT_NE(second, nullptr);
+		EXPECT_EQ(log.acquired, 2);
+		EXPECT_EQ(handler.arenas[0].backing, ArenaBacking::Upstream);
+
+		// Fully free arenas go back upstream, the rest when the handler dies.
+		EXPECT_EQ(handler.free_memory(second, 4 << 20), ErrorCode::Success);
+		EXPECT_EQ(log.released, 1);
+	}
+
+	EXPECT_EQ(log.released, 2);
+}
+
+TEST(UpstreamTest, MissingUpstreamFails)
+{
+	ArenaHandler handler;
+	handler.arena_backing = ArenaBacking::Upstream;
+	EXPECT_EQ(handler.request_memory(100, 8), nullptr);
+}
+
+TEST(UpstreamTest, SeedBlocksAreUsedAndNeverFreed)
+{
+	alignas(64) static int8_t seed[64 << 10];
+	{
+		ArenaHandler handler;
+		handler.arena_backing = ArenaBacking::Seeded;
+		handler.retained_free_arenas = 0;
+		handler.arena_decay_ms = 0;
+		EXPECT_EQ(handler.add_seed_block(nullptr, 100), ErrorCode::InvalidArgument);
+		ASSERT_EQ(handler.add_seed_block(seed, sizeof(seed)), ErrorCode::Success);
+
+		void* ptr = handler.request_memory(1000, 16);
+		ASSERT_NE(ptr, nullptr);
+		EXPECT_GE((int8_t*)ptr, seed);
+		EXPECT_LT((int8_t*)ptr, seed + sizeof(seed));
+
+		// The seed stays put when it empties, and nothing else is allocated.
+		EXPECT_EQ(handler.free_memory(ptr, 1000), ErrorCode::Success);
+		EXPECT_EQ(handler.trim(), 0);
+		EXPECT_EQ(handler.arenas[0].mem_block, seed);
+		EXPECT_EQ(handler.request_memory(sizeof(seed) * 2, 8), nullptr);
+		EXPECT_EQ(handler.ds_info.arenas_len, 1);
+	}
+
+	// Still the caller's memory after the handler is gone.
+	memset(seed, 0, sizeof(seed));
+}
+
+TEST(UpstreamTest, SeedBlocksBecomeTlsfPools)
+{
+	alignas(64) static int8_t seed[64 << 10];
+	ArenaHandler handler;
+	handler.mode = AllocationMode::Tlsf;
+	handler.arena_backing = ArenaBacking::Seeded;
+	ASSERT_EQ(handler.add_seed_block(seed, sizeof(seed)), ErrorCode::Success);
+	EXPECT_EQ(handler.add_seed_block(seed, 8), ErrorCode::InvalidArgument);
+
+	void* ptr = handler.request_memory(1000, 16);
+	ASSERT_NE(ptr, nullptr);
+	EXPECT_GE((int8_t*)ptr, seed);
+	EXPECT_LT((int8_t*)ptr, seed + sizeof(seed));
+	EXPECT_EQ(handler.free_memory(ptr), ErrorCode::Success);
+}
+
+TEST(ArenaHandlerConfigTest, GrowsPastFormerArenaLimit)
+{
+	ArenaHandlerConfig config;
+	config.arena_size = 4096;
+	config.request_growth_factor = 1;
+	config.arena_growth_factor = 1;
+	ArenaHandler handler(config);
+
+	// One exactly full arena per request, well past the old 12-bit cap of 4095.
+	constexpr size_t count = 5000;
+	void** ptrs = (void**)malloc(sizeof(void*) * count);
+	ASSERT_NE(ptrs, nullptr);
+	for (size_t ii = 0; ii < count; ii++)
+	{
+		ptrs[ii] = handler.request_memory(4096, 8);
+		ASSERT_NE(ptrs[ii], nullptr);
+	}
+
+	EXPECT_EQ(handler.ds_info.arenas_len, count);
+	EXPECT_GE(handler.ds_info.arenas_capacity, count);
+	for (size_t ii = 0; ii < count; ii++)
+	{
+		EXPECT_EQ(handler.free_memory(ptrs[ii], 4096), ErrorCode::Success);
+	}
+
+	free(ptrs);
+}
+
+TEST(ConcurrentArenaHandlerTest, BumpsTheFrontierAndReusesFreedMemory)
+{
+	ConcurrentArenaHandler handler;
+	void* first = handler.request_memory(100, 8);
+	void* second = handler.request_memory(20, 8);
+	ASSERT_NE(first, nullptr);
+	ASSERT_NE(second, nullptr);
+
+	// Sizes are rounded to the quantum, so the frontier stays aligned.
+	EXPECT_EQ((int8_t*)second, (int8_t*)first + 112);
+	EXPECT_EQ(handler.frontier, (int8_t*)second + 32);
+	EXPECT_EQ(handler.free_classes.load(), 0);
+
+	// Freed memory is published and served again before the frontier moves.
+	EXPECT_EQ(handler.free_memory(first, 100), ErrorCode::Success);
+	EXPECT_NE(handler.free_classes.load(), 0);
+	EXPECT_EQ(handler.request_memory(100, 8), first);
+	EXPECT_EQ(handler.free_memory(second, 20), ErrorCode::Success);
+}
+
+TEST(ConcurrentArenaHandlerTest, OverAlignedPaddingIsFreed)
+{
+	// Mapped arenas start on a 2MB boundary, so the frontier chunk does too and
+	// the padding doesn't depend on where malloc places the arena.
+	ArenaHandlerConfig config;
+	config.arena_backing = ArenaBacking::Mmap;
+	ConcurrentArenaHandler handler(config);
+	void* small = handler.request_memory(16, 8);
+	void* aligned = handler.request_memory(64, 128);
+	ASSERT_NE(small, nullptr);
+	ASSERT_NE(aligned, nullptr);
+	EXPECT_EQ((uintptr_t)aligned % 128, 0);
+
+	// The padding is back in the free blocks or slivers, leaving only the two
+	// allocations and the frontier chunk live.
+	const size_t padding = (int8_t*)aligned - (int8_t*)small - 16;
+	EXPECT_GT(padding, 0);
+	EXPECT_EQ(handler.handler.arenas[0].live_bytes,
+		DEFAULT_FRONTIER_CHUNK_SIZE - padding);
+	EXPECT_EQ(handler.free_memory(small, 16), ErrorCode::Success);
+	EXPECT_EQ(handler.free_memory(aligned, 64), ErrorCode::Success);
+}
+
+TEST(ConcurrentArenaHandlerTest, LargeRequestsSkipTheFrontier)
+{
+	ConcurrentArenaHandler handler;
+	void* large = handler.request_memory(DEFAULT_FRONTIER_CHUNK_SIZE, 8);
+	ASSERT_NE(large, nullptr);
+	EXPECT_EQ(handler.frontier, nullptr);
+	EXPECT_EQ(handler.free_memory(large, DEFAULT_FRONTIER_CHUNK_SIZE),
+		ErrorCode::Success);
+}
+
+TEST(ConcurrentArenaHandlerTest, ThreadsShareOneHandler)
+{
+	ArenaHandlerConfig config;
+	config.retained_free_arenas = 0;
+	config.arena_decay_ms = 0;
+	ConcurrentArenaHandler handler(config);
+
+	constexpr int threads_len = 8;
+	constexpr int live_len = 64;
+	bool failed[threads_len] = {};
+	std::thread threads[threads_len];
+	for (int tt = 0; tt < threads_len; tt++)
+	{
+		threads[tt] = std::thread([&handler, &failed, tt]() {
+			uint8_t* ptrs[live_len] = {};
+			size_t sizes[live_len] = {};
+			uint32_t state = 2463534242u + tt;
+			for (int ii = 0; ii < 10000; ii++)
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				const int slot = state % live_len;
+				if (ptrs[slot] != nullptr)
+				{
+					for (size_t kk = 0; kk < sizes[slot]; kk++)
+					{
+						failed[tt] |= ptrs[slot][kk] != (uint8_t)(tt + slot);
+					}
+
+					failed[tt] |= handler.free_memory(ptrs[slot], sizes[slot]) !=
+						ErrorCode::Success;
+				}
+
+				sizes[slot] = 1 + (state >> 8) % (state % 16 == 0 ? 40000 : 300);
+				const uint8_t alignment = (uint8_t)(1 << ((state >> 24) % 8));
+				ptrs[slot] = (uint8_t*)handler.request_memory(sizes[slot], alignment);
+				failed[tt] |= ptrs[slot] == nullptr ||
+					(uintptr_t)ptrs[slot] % alignment != 0;
+				if (ptrs[slot] != nullptr)
+				{
+					memset(ptrs[slot], tt + slot, sizes[slot]);
+				}
+			}
+
+			for (int slot = 0; slot < live_len; slot++)
+			{
+				if (ptrs[slot] != nullptr)
+				{
+					failed[tt] |= handler.free_memory(ptrs[slot], sizes[slot]) !=
+						ErrorCode::Success;
+				}
+			}
+		});
+	}
+
+	for (int tt = 0; tt < threads_len; tt++)
+	{
+		threads[tt].join();
+		EXPECT_FALSE(failed[tt]) << "thread " << tt;
+	}
+
+	// Only the frontier chunk is still live.
+	size_t live_bytes = 0;
+	for (size_t ii = 0; ii < handler.handler.ds_info.arenas_len; ii++)
+	{
+		live_bytes += handler.handler.arenas[ii].live_bytes;
+	}
+
+	EXPECT_EQ(live_bytes, (size_t)(handler.frontier_end - handler.frontier));
+}
+
+TEST(ThreadCacheTest, ReusesFreedBlocksWithoutTheSharedHandler)
+{
+	ConcurrentArenaHandler shared;
+	ThreadCache cache(shared);
+	void* first = cache.request_memory(40, 8);
+	void* second = cache.request_memory(40, 8);
+	ASSERT_NE(first, nullptr);
+	EXPECT_EQ((int8_t*)second, (int8_t*)first + 48);
+	EXPECT_EQ(cache.bump_end - cache.bump, DEFAULT_THREAD_CACHE_CHUNK_SIZE - 96);
+
+	// Freed blocks stay in the cache and come back last in, first out.
+	EXPECT_EQ(cache.free_memory(first, 40), ErrorCode::Success);
+	EXPECT_EQ(cache.free_memory(second, 33), ErrorCode::Success);
+	EXPECT_EQ(cache.class_lens[2], 2);
+	EXPECT_EQ(shared.free_classes.load(), 0);
+	EXPECT_EQ(cache.request_memory(48, 8), second);
+	EXPECT_EQ(cache.request_memory(36, 1), first);
+	EXPECT_EQ(cache.class_lens[2], 0);
+}
+
+TEST(ThreadCacheTest, OverflowingClassReturnsHalf)
+{
+	ConcurrentArenaHandler shared;
+	ThreadCache cache(shared);
+	cache.class_limit = 8;
+
+	void* ptrs[9] = {};
+	for (void*& ptr : ptrs)
+	{
+		ptr = cache.request_memory(64, 16);
+		ASSERT_NE(ptr, nullptr);
+	}
+
+	for (void* ptr : ptrs)
+	{
+		EXPECT_EQ(cache.free_memory(ptr, 64), ErrorCode::Success);
+	}
+
+	// The ninth free overflows the class, keeping the four freed last.
+	EXPECT_EQ(cache.class_lens[3], 4);
+	EXPECT_NE(shared.free_classes.load(), 0);
+	EXPECT_EQ(cache.request_memory(64, 16), ptrs[8]);
+	EXPECT_EQ(shared.handler.arenas[0].live_bytes,
+		DEFAULT_FRONTIER_CHUNK_SIZE - 5 * 64);
+}
+
+TEST(ThreadCacheTest, RejectedBlocksDontLoseTheRest)
+{
+	ConcurrentArenaHandler shared;
+	ThreadCache cache(shared);
+
+	void* ptrs[8] = {};
+	for (void*& ptr : ptrs)
+	{
+		ptr = cache.request_memory(64, 16);
+		ASSERT_NE(ptr, nullptr);
+		EXPECT_EQ(cache.free_memory(ptr, 64), ErrorCode::Success);
+	}
+
+	// The foreign block sinks its batch, but the cached blocks still go back.
+	alignas(16) int8_t foreign[64];
+	EXPECT_EQ(cache.free_memory(foreign, sizeof(foreign)), ErrorCode::Success);
+	EXPECT_EQ(cache.flush(), ErrorCode::InvalidArgument);
+	EXPECT_EQ(shared.handler.arenas[0].live_bytes,
+		(size_t)(shared.frontier_end - shared.frontier));
+	EXPECT_EQ(cache.flush(), ErrorCode::Success);
+}
+
+TEST(ThreadCacheTest, LargeAndOverAlignedRequestsBypassTheCache)
+{
+	ConcurrentArenaHandler shared;
+	ThreadCache cache(shared);
+	void* large = cache.request_memory(THREAD_CACHE_MAX_SIZE + 1, 8);
+	void* aligned = cache.request_memory(32, 64);
+	ASSERT_NE(large, nullptr);
+	ASSERT_NE(aligned, nullptr);
+	EXPECT_EQ((uintptr_t)aligned % 64, 0);
+	EXPECT_EQ(cache.bump, nullptr);
+
+	EXPECT_EQ(cache.free_memory(large, THREAD_CACHE_MAX_SIZE + 1),
+		ErrorCode::Success);
+	EXPECT_EQ(cache.free_memory(aligned, 32), ErrorCode::Success);
+	EXPECT_EQ(cache.class_lens[1], 1);
+}
+
+TEST(ThreadCacheTest, ThreadExitFlushesToTheSharedHandler)
+{
+	ArenaHandlerConfig config;
+	config.retained_free_arenas = 0;
+	config.arena_decay_ms = 0;
+	ConcurrentArenaHandler shared(config);
+
+	// Each thread frees half of what its neighbour allocated.
+	constexpr int threads_len = 4;
+	constexpr int blocks_len = 2000;
+	void* blocks[threads_len][blocks_len] = {};
+	std::thread threads[threads_len];
+	for (int tt = 0; tt < threads_len; tt++)
+	{
+		threads[tt] = std::thread([&shared, &blocks, tt]() {
+			thread_local ThreadCache cache(shared);
+			for (int ii = 0; ii < blocks_len; ii++)
+			{
+				blocks[tt][ii] = cache.request_memory(16 + ii % 200, 8);
+			}
+		});
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	for (int tt = 0; tt < threads_len; tt++)
+	{
+		threads[tt] = std::thread([&shared, &blocks, tt]() {
+			thread_local ThreadCache cache(shared);
+			for (int ii = 0; ii < blocks_len; ii++)
+			{
+				EXPECT_NE(blocks[(tt + 1) % threads_len][ii], nullptr);
+				EXPECT_EQ(cache.free_memory(blocks[(tt + 1) % threads_len][ii],
+							  16 + ii % 200),
+					ErrorCode::Success);
+			}
+		});
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	// Every block and bump chunk tail is back, leaving only the frontier chunk.
+	size_t live_bytes = 0;
+	for (size_t ii = 0; ii < shared.handler.ds_info.arenas_len; ii++)
+	{
+		live_bytes += shared.handler.arenas[ii].live_bytes;
+	}
+
+	EXPECT_EQ(live_bytes, (size_t)(shared.frontier_end - shared.frontier));
+}
+
+TEST(ShardedArenaHandlerTest, FreesReachTheOwningShard)
+{
+	ShardedArenaHandler handler(ArenaHandlerConfig(), 4);
+	ASSERT_EQ(handler.shards_len, 4);
+	EXPECT_LT(handler.current_shard(), 4);
+
+	void* ptrs[4] = {};
+	for (uint32_t ii = 0; ii < 4; ii++)
+	{
+		ptrs[ii] = handler.shards[ii].request_memory(100, 8);
+		ASSERT_NE(ptrs[ii], nullptr);
+	}
+
+	// Whichever CPU this runs on, at least three frees cross shards.
+	for (uint32_t ii = 0; ii < 4; ii++)
+	{
+		EXPECT_EQ(handler.free_memory(ptrs[ii], 100), ErrorCode::Success);
+		EXPECT_NE(handler.shards[ii].free_classes.load(), 0);
+	}
+
+	EXPECT_GE(handler.cross_shard_frees.load(), 3);
+
+	int8_t foreign[64];
+	EXPECT_EQ(handler.free_memory(foreign, sizeof(foreign)),
+		ErrorCode::InvalidArgument);
+}
+
+TEST(ShardedArenaHandlerTest, RangeTableTracksArenas)
+{
+	ArenaHandlerConfig config;
+	config.arena_size = 4096;
+	config.request_growth_factor = 1;
+	config.arena_growth_factor = 1;
+	config.retained_free_arenas = 0;
+	config.arena_decay_ms = 0;
+	ShardedArenaHandler handler(config, 2);
+
+	// Large requests skip the frontier, so each gets an arena of its own, more
+	// than the first table holds.
+	constexpr uint32_t ptrs_len = INITIAL_SHARD_RANGES_CAPACITY * 2;
+	void* ptrs[ptrs_len] = {};
+	for (uint32_t ii = 0; ii < ptrs_len; ii++)
+	{
+		ptrs[ii] = handler.shards[ii % 2].request_memory(1 << 15, 8);
+		ASSERT_NE(ptrs[ii], nullptr);
+	}
+
+	EXPECT_EQ(handler.ranges_len.load(), ptrs_len);
+	EXPECT_GT(handler.range_table.load(), 0);
+	for (uint32_t ii = 0; ii < ptrs_len; ii++)
+	{
+		EXPECT_EQ(handler.find_shard(ptrs[ii]), ii % 2);
+		EXPECT_EQ(handler.find_shard((int8_t*)ptrs[ii] + (1 << 15) - 1), ii % 2);
+	}
+
+	// Released arenas leave the table.
+	for (uint32_t ii = 0; ii < ptrs_len; ii++)
+	{
+		EXPECT_EQ(handler.free_memory(ptrs[ii], 1 << 15), ErrorCode::Success);
+	}
+
+	EXPECT_EQ(handler.ranges_len.load(), 0);
+	EXPECT_EQ(handler.find_shard(ptrs[0]), handler.shards_len);
+	EXPECT_FALSE(handler.ranges_incomplete.load());
+}
+
+TEST(ShardedArenaHandlerTest, DryShardsBorrowFromTheOthers)
+{
+	alignas(64) static int8_t seed[256 << 10];
+	ArenaHandlerConfig config;
+	config.arena_backing = ArenaBacking::Seeded;
+	ShardedArenaHandler handler(config, 2);
+
+	// Only one shard has memory, so requests landing on the other overflow.
+	const uint32_t seeded = (handler.current_shard() + 1) % 2;
+	ASSERT_EQ(handler.shards[seeded].handler.add_seed_block(seed, sizeof(seed)),
+		ErrorCode::Success);
+
+	void* ptrs[8] = {};
+	for (void*& ptr : ptrs)
+	{
+		ptr = handler.request_memory(200, 8);
+		ASSERT_NE(ptr, nullptr);
+		EXPECT_TRUE(handler.shards[seeded].handler.owns(ptr));
+	}
+
+	EXPECT_GT(handler.overflowed_requests.load(), 0);
+	for (void* ptr : ptrs)
+	{
+		EXPECT_EQ(handler.free_memory(ptr, 200), ErrorCode::Success);
+	}
+
+	// The freed blocks merge and are reused before the frontier moves on.
+	EXPECT_EQ(handler.request_memory(200, 8), ptrs[0]);
+	EXPECT_EQ(handler.free_memory(ptrs[0], 200), ErrorCode::Success);
+}
+
+TEST(ShardedArenaHandlerTest, ThreadsFreeAcrossShards)
+{
+	ArenaHandlerConfig config;
+	config.retained_free_arenas = 0;
+	config.arena_decay_ms = 0;
+	ShardedArenaHandler handler(config, 4);
+
+	// Each thread frees what its neighbour allocated.
+	constexpr int threads_len = 4;
+	constexpr int blocks_len = 2000;
+	void* blocks[threads_len][blocks_len] = {};
+	std::thread threads[threads_len];
+	for (int tt = 0; tt < threads_len; tt++)
+	{
+		threads[tt] = std::thread([&handler, &blocks, tt]() {
+			for (int ii = 0; ii < blocks_len; ii++)
+			{
+				blocks[tt][ii] = handler.request_memory(16 + ii % 200, 8);
+			}
+		});
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	for (int tt = 0; tt < threads_len; tt++)
+	{
+		threads[tt] = std::thread([&handler, &blocks, tt]() {
+			for (int ii = 0; ii < blocks_len; ii++)
+			{
+				EXPECT_NE(blocks[(tt + 1) % threads_len][ii], nullptr);
+				EXPECT_EQ(handler.free_memory(blocks[(tt + 1) % threads_len][ii],
+							  16 + ii % 200),
+					ErrorCode::Success);
+			}
+		});
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	// Only each shard's frontier chunk is still live.
+	for (uint32_t ss = 0; ss < handler.shards_len; ss++)
+	{
+		const ConcurrentArenaHandler& shard = handler.shards[ss];
+		size_t live_bytes = 0;
+		for (size_t ii = 0; ii < shard.handler.ds_info.arenas_len; ii++)
+		{
+			live_bytes += shard.handler.arenas[ii].live_bytes;
+		}
+
+		EXPECT_EQ(live_bytes, (size_t)(shard.frontier_end - shard.frontier));
+	}
 }
@@ -0,0 +1,196 @@
+#include "thread_cache.hpp"
+
+namespace mem_arena_handler
+{
+
+// Blocks handed back to the shared handler per call to free_memory_batch.
+constexpr size_t THREAD_CACHE_FLUSH_BATCH = 64;
+
+ThreadCache::ThreadCache(ConcurrentArenaHandler& shared) : shared(shared)
+{
+}
+
+ThreadCache::~ThreadCache()
+{
+	(void)flush();
+}
+
+/**
+ * @brief Collects blocks for the shared handler, handing them back a batch at a
+ * time so adjacent ones can merge under a single lock.
+ *
+ * The first error from any batch is kept and returned by the last send().
+ **/
+struct ReturnBatch
+{
+	explicit ReturnBatch(ConcurrentArenaHandler& shared) : shared(shared)
+	{
+	}
+
+	void add(void* ptr, const size_t size)
+	{
+		requests[len].ptr = ptr;
+		requests[len].size = size;
+		if (++len == THREAD_CACHE_FLUSH_BATCH)
+		{
+			(void)send();
+		}
+	}
+
+	ErrorCode send()
+	{
+		ErrorCode sent = shared.free_memory_batch(requests, len);
+
+		// A rejected batch frees nothing, so free its blocks one at a time and
+		// lose only the bad ones.
+		if (sent != ErrorCode::Success)
+		{
+			sent = ErrorCode::Success;
+			for (size_t ii = 0; ii < len; ii++)
+			{
+				const ErrorCode freed =
+					shared.free_memory(requests[ii].ptr, requests[ii].size);
+				if (sent == ErrorCode::Success)
+				{
+					sent = freed;
+				}
+			}
+		}
+
+		if (result == ErrorCode::Success)
+		{
+			result = sent;
+		}
+
+		len = 0;
+		return result;
+	}
+
+	ConcurrentArenaHandler& shared;
+	FreeRequest requests[THREAD_CACHE_FLUSH_BATCH];
+	size_t len = 0;
+	ErrorCode result = ErrorCode::Success;
+};
+
+/**
+ * @brief Hands the blocks of class `class_index` listed from `block` on back to
+ * the shared handler.
+ **/
+static void return_blocks(
+	ReturnBatch& batch, const uint8_t class_index, CachedBlock* block)
+{
+	const size_t size = (class_index + 1) * CONCURRENT_SIZE_QUANTUM;
+	while (block != nullptr)
+	{
+		CachedBlock* next = block->next;
+		batch.add(block, size);
+		block = next;
+	}
+}
+
+/**
+ * @brief Returns the rest of the bump chunk and leases a new one of
+ * `chunk_size` bytes.
+ **/
+[[nodiscard]]
+static bool refill_bump(ThreadCache& cache)
+{
+	if (cache.bump != cache.bump_end)
+	{
+		(void)cache.shared.free_memory(cache.bump, cache.bump_end - cache.bump);
+	}
+
+	int8_t* chunk = (int8_t*)cache.shared.request_memory(
+		cache.chunk_size, CONCURRENT_SIZE_QUANTUM);
+	if (chunk == nullptr)
+	{
+		cache.bump = nullptr;
+		cache.bump_end = nullptr;
+		return false;
+	}
+
+	cache.bump = chunk;
+	cache.bump_end = chunk + round_to_quantum(cache.chunk_size);
+	return true;
+}
+
+void* ThreadCache::request_memory(const size_t size, const uint8_t alignment)
+{
+	// Everything in the cache is aligned to the quantum and no further.
+	if (size > THREAD_CACHE_MAX_SIZE || alignment > CONCURRENT_SIZE_QUANTUM)
+	{
+		return shared.request_memory(size, alignment);
+	}
+
+	const size_t rounded = round_to_quantum(size == 0 ? 1 : size);
+	const uint8_t class_index = (uint8_t)(rounded / CONCURRENT_SIZE_QUANTUM - 1);
+	if (CachedBlock* block = class_heads[class_index]; block != nullptr)
+	{
+		class_heads[class_index] = block->next;
+		class_lens[class_index]--;
+		return block;
+	}
+
+	if ((size_t)(bump_end - bump) < rounded && !refill_bump(*this))
+	{
+		return nullptr;
+	}
+
+	void* ptr = bump;
+	bump += rounded;
+	return ptr;
+}
+
+ErrorCode ThreadCache::free_memory(void* ptr, const size_t size)
+{
+	if (size > THREAD_CACHE_MAX_SIZE)
+	{
+		return shared.free_memory(ptr, size);
+	}
+
+	const size_t rounded = round_to_quantum(size == 0 ? 1 : size);
+	const uint8_t class_index = (uint8_t)(rounded / CONCURRENT_SIZE_QUANTUM - 1);
+	CachedBlock* block = (CachedBlock*)ptr;
+	block->next = class_heads[class_index];
+	class_heads[class_index] = block;
+	if (++class_lens[class_index] <= class_limit)
+	{
+		return ErrorCode::Success;
+	}
+
+	// Keep the most recently freed half, which is likeliest still in cache.
+	const uint32_t keep = class_lens[class_index] / 2;
+	CachedBlock** tail = &class_heads[class_index];
+	for (uint32_t ii = 0; ii < keep; ii++)
+	{
+		tail = &(*tail)->next;
+	}
+
+	ReturnBatch batch(shared);
+	return_blocks(batch, class_index, *tail);
+	*tail = nullptr;
+	class_lens[class_index] = keep;
+	return batch.send();
+}
+
+ErrorCode ThreadCache::flush()
+{
+	ReturnBatch batch(shared);
+	for (uint8_t ii = 0; ii < THREAD_CACHE_CLASSES; ii++)
+	{
+		return_blocks(batch, ii, class_heads[ii]);
+		class_heads[ii] = nullptr;
+		class_lens[ii] = 0;
+	}
+
+	if (bump != bump_end)
+	{
+		batch.add(bump, bump_end - bump);
+	}
+
+	bump = nullptr;
+	bump_end = nullptr;
+	return batch.send();
+}
+
+} // namespace mem_arena_handler
@@ -0,0 +1,85 @@
+#ifndef THREAD_CACHE_HPP
+#define THREAD_CACHE_HPP
+
+#include "concurrent_arena_handler.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace mem_arena_handler
+{
+
+// Requests up to this size, in multiples of CONCURRENT_SIZE_QUANTUM, are served
+// from the cache. One class per multiple.
+constexpr size_t THREAD_CACHE_MAX_SIZE = 1024;
+constexpr uint8_t THREAD_CACHE_CLASSES =
+	(uint8_t)(THREAD_CACHE_MAX_SIZE / CONCURRENT_SIZE_QUANTUM);
+
+constexpr uint32_t DEFAULT_THREAD_CACHE_CLASS_LIMIT = 64;
+constexpr size_t DEFAULT_THREAD_CACHE_CHUNK_SIZE = 1 << 14;
+
+/**
+ * @brief Record for a freed block held in a ThreadCache, stored at the start of
+ * the block itself.
+ **/
+struct CachedBlock
+{
+	CachedBlock* next = nullptr;
+};
+
+/**
+ * @brief A single thread's cache in front of a shared ConcurrentArenaHandler.
+ *
+ * Small requests are served from blocks the thread freed earlier, kept in one
+ * list per rounded size, and otherwise bumped from a chunk leased from `shared`.
+ * Neither path takes a lock or touches an atomic. Only leasing a new chunk and
+ * giving memory back reach `shared`.
+ *
+ * A list that grows past `class_limit` hands half its blocks back in one
+ * batch. The destructor flushes everything, so a cache declared thread_local or
+ * on a thread's stack returns its memory when the thread exits. It must not
+ * outlive `shared`.
+ *
+ * Blocks may be freed to a different thread's cache than the one that served
+ * them. Cached memory still counts as live in its arena until it is flushed.
+ **/
+struct ThreadCache
+{
+	explicit ThreadCache(ConcurrentArenaHandler& shared);
+	~ThreadCache();
+
+	ThreadCache(const ThreadCache&) = delete;
+	ThreadCache& operator=(const ThreadCache&) = delete;
+
+	[[nodiscard]]
+	void* request_memory(const size_t size, const uint8_t alignment);
+
+	[[nodiscard]]
+	ErrorCode free_memory(void* ptr, const size_t size);
+
+	/**
+	 * @brief Returns every cached block and the rest of the bump chunk to
+	 * `shared`.
+	 *
+	 * Blocks `shared` rejects, such as ones it doesn't own, are dropped and the
+	 * first error is returned; the rest are still returned.
+	 **/
+	[[nodiscard]]
+	ErrorCode flush();
+
+	ConcurrentArenaHandler& shared;
+
+	CachedBlock* class_heads[THREAD_CACHE_CLASSES] = {};
+	uint32_t class_lens[THREAD_CACHE_CLASSES] = {};
+	uint32_t class_limit = DEFAULT_THREAD_CACHE_CLASS_LIMIT;
+
+	// The unused part of the chunk leased from `shared`, bumped in multiples of
+	// CONCURRENT_SIZE_QUANTUM.
+	int8_t* bump = nullptr;
+	int8_t* bump_end = nullptr;
+	size_t chunk_size = DEFAULT_THREAD_CACHE_CHUNK_SIZE;
+};
+
+} // namespace mem_arena_handler
+
+#endif // THREAD_CACHE_HPP
@@ -0,0 +1,413 @@
+#include "tlsf.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+namespace mem_arena_handler
+{
+
+// Every block is aligned to and sized in multiples of ALIGN_SIZE, leaving the low
+// bits of TlsfBlock::size free for the status flags.
+constexpr uint8_t ALIGN_SIZE_LOG2 = 4;
+constexpr size_t ALIGN_SIZE = 1 << ALIGN_SIZE_LOG2;
+
+// Each first-level (power-of-two) range is split into SL_INDEX_COUNT linear
+// second-level lists. Sizes below SMALL_BLOCK_SIZE all share first level 0.
+constexpr uint8_t SL_INDEX_COUNT_LOG2 = 4;
+constexpr uint8_t SL_INDEX_COUNT = 1 << SL_INDEX_COUNT_LOG2;
+constexpr uint8_t FL_INDEX_MAX = 40;
+constexpr uint8_t FL_INDEX_SHIFT = SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2;
+constexpr uint8_t FL_INDEX_COUNT = FL_INDEX_MAX - FL_INDEX_SHIFT + 1;
+constexpr size_t SMALL_BLOCK_SIZE = 1 << FL_INDEX_SHIFT;
+
+constexpr size_t BLOCK_FREE_BIT = 1 << 0;
+constexpr size_t BLOCK_PREV_FREE_BIT = 1 << 1;
+constexpr size_t BLOCK_FLAG_BITS = BLOCK_FREE_BIT | BLOCK_PREV_FREE_BIT;
+
+/**
+ * @brief Boundary tag preceding every block's payload.
+ *
+ * `prev_phys` always points at the physically previous block, and the flags in
+ * `size` say whether this block and the previous one are free, so both neighbours
+ * of a freed block are found with pointer arithmetic alone. The free list links
+ * overlay the payload and are only valid while the block is free.
+ **/
+struct TlsfBlock
+{
+	TlsfBlock* prev_phys;
+	size_t size;
+	TlsfBlock* next_free;
+	TlsfBlock* prev_free;
+};
+
+constexpr size_t BLOCK_HEADER_SIZE = offsetof(TlsfBlock, next_free);
+constexpr size_t BLOCK_SIZE_MIN = sizeof(TlsfBlock) - BLOCK_HEADER_SIZE;
+constexpr size_t BLOCK_SIZE_MAX = (size_t)1 << FL_INDEX_MAX;
+
+// Smallest gap that can be split off in front of an over-aligned payload.
+constexpr size_t ALIGN_GAP_MIN = BLOCK_HEADER_SIZE + BLOCK_SIZE_MIN;
+
+struct TlsfControl
+{
+	uint64_t fl_bitmap;
+	uint32_t sl_bitmap[FL_INDEX_COUNT];
+	TlsfBlock* blocks[FL_INDEX_COUNT][SL_INDEX_COUNT];
+};
+
+static_assert(FL_INDEX_COUNT <= 64, "First-level bitmap is 64 bits wide.");
+static_assert(SL_INDEX_COUNT <= 32, "Second-level bitmaps are 32 bits wide.");
+
+[[nodiscard]]
+static inline uint8_t find_last_set(const size_t value)
+{
+	return (uint8_t)(63 - __builtin_clzll((uint64_t)value));
+}
+
+[[nodiscard]]
+static inline size_t block_size(const TlsfBlock* block)
+{
+	return block->size & ~BLOCK_FLAG_BITS;
+}
+
+static inline void set_block_size(TlsfBlock* block, const size_t size)
+{
+	block->size = size | (block->size & BLOCK_FLAG_BITS);
+}
+
+[[nodiscard]]
+static inline void* block_to_ptr(TlsfBlock* block)
+{
+	return (int8_t*)block + BLOCK_HEADER_SIZE;
+}
+
+[[nodiscard]]
+static inline TlsfBlock* ptr_to_block(const void* ptr)
+{
+	return (TlsfBlock*)((int8_t*)ptr - BLOCK_HEADER_SIZE);
+}
+
+[[nodiscard]]
+static inline TlsfBlock* next_block(TlsfBlock* block)
+{
+	return (TlsfBlock*)((int8_t*)block_to_ptr(block) + block_size(block));
+}
+
+/**
+ * @brief Rounds a request up to a valid block size, or returns 0 if it can never
+ * be satisfied.
+ **/
+[[nodiscard]]
+static inline size_t adjust_request_size(const size_t size)
+{
+	if (size >= BLOCK_SIZE_MAX)
+	{
+		return 0;
+	}
+
+	const size_t aligned = (size + ALIGN_SIZE - 1) & ~(ALIGN_SIZE - 1);
+	return aligned < BLOCK_SIZE_MIN ? BLOCK_SIZE_MIN : aligned;
+}
+
+/**
+ * @brief Maps a block size to the list it is stored in.
+ **/
+static inline void mapping_insert(const size_t size, uint8_t& fl, uint8_t& sl)
+{
+	if (size < SMALL_BLOCK_SIZE)
+	{
+		fl = 0;
+		sl = (uint8_t)(size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT));
+		return;
+	}
+
+	const uint8_t last_set = find_last_set(size);
+	sl = (uint8_t)((size >> (last_set - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT);
+	fl = last_set - (FL_INDEX_SHIFT - 1);
+}
+
+/**
+ * @brief Maps a request to the first list whose blocks are all large enough.
+ **/
+static inline void mapping_search(const size_t size, uint8_t& fl, uint8_t& sl)
+{
+	size_t rounded = size;
+	if (size >= SMALL_BLOCK_SIZE)
+	{
+		rounded += ((size_t)1 << (find_last_set(size) - SL_INDEX_COUNT_LOG2)) - 1;
+	}
+
+	mapping_insert(rounded, fl, sl);
+}
+
+[[nodiscard]]
+static inline TlsfBlock* search_suitable_block(
+	TlsfControl* control, uint8_t& fl, uint8_t& sl)
+{
+	if (fl >= FL_INDEX_COUNT)
+	{
+		return nullptr;
+	}
+
+	uint32_t sl_map = control->sl_bitmap[fl] & (~0u << sl);
+	if (sl_map == 0)
+	{
+		const uint64_t fl_map =
+			fl + 1 < 64 ? control->fl_bitmap & (~0ull << (fl + 1)) : 0;
+		if (fl_map == 0)
+		{
+			return nullptr;
+		}
+
+		fl = (uint8_t)__builtin_ctzll(fl_map);
+		sl_map = control->sl_bitmap[fl];
+	}
+
+	sl = (uint8_t)__builtin_ctz(sl_map);
+	return control->blocks[fl][sl];
+}
+
+static inline void insert_free_block(TlsfControl* control, TlsfBlock* block)
+{
+	uint8_t fl;
+	uint8_t sl;
+	mapping_insert(block_size(block), fl, sl);
+
+	TlsfBlock* head = control->blocks[fl][sl];
+	block->next_free = head;
+	block->prev_free = nullptr;
+	if (head != nullptr)
+	{
+		head->prev_free = block;
+	}
+
+	control->blocks[fl][sl] = block;
+	control->fl_bitmap |= 1ull << fl;
+	control->sl_bitmap[fl] |= 1u << sl;
+}
+
+static inline void remove_free_block(TlsfControl* control, TlsfBlock* block)
+{
+	uint8_t fl;
+	uint8_t sl;
+	mapping_insert(block_size(block), fl, sl);
+
+	if (block->prev_free != nullptr)
+	{
+		block->prev_free->next_free = block->next_free;
+	}
+
+	else
+	{
+		control->blocks[fl][sl] = block->next_free;
+	}
+
+	if (block->next_free != nullptr)
+	{
+		block->next_free->prev_free = block->prev_free;
+	}
+
+	if (control->blocks[fl][sl] == nullptr)
+	{
+		control->sl_bitmap[fl] &= ~(1u << sl);
+		if (control->sl_bitmap[fl] == 0)
+		{
+			control->fl_bitmap &= ~(1ull << fl);
+		}
+	}
+}
+
+/**
+ * @brief Splits a free, unlisted block so it holds exactly `size` bytes, and
+ * returns the remainder to the free lists if it is large enough to track.
+ **/
+static inline void trim_free_block(
+	TlsfControl* control, TlsfBlock* block, const size_t size)
+{
+	const size_t total = block_size(block);
+	if (total < size + ALIGN_GAP_MIN)
+	{
+		return;
+	}
+
+	set_block_size(block, size);
+	TlsfBlock* remaining = next_block(block);
+	remaining->prev_phys = block;
+	remaining->size = (total - size - BLOCK_HEADER_SIZE) | BLOCK_FREE_BIT |
+		BLOCK_PREV_FREE_BIT;
+
+	// The block after the remainder cannot be free, as free blocks are always
+	// coalesced.
+	TlsfBlock* next = next_block(remaining);
+	next->prev_phys = remaining;
+	next->size |= BLOCK_PREV_FREE_BIT;
+	insert_free_block(control, remaining);
+}
+
+TlsfControl* tlsf_create_control()
+{
+	TlsfControl* control = (TlsfControl*)malloc(sizeof(TlsfControl));
+	if (control == nullptr)
+	{
+		return nullptr;
+	}
+
+	memset((void*)control, 0, sizeof(TlsfControl));
+	return control;
+}
+
+void tlsf_destroy_control(TlsfControl* control)
+{
+	free(control);
+}
+
+size_t tlsf_pool_overhead(const size_t size, const uint8_t alignment)
+{
+	size_t search = size + ALIGN_SIZE;
+	if (alignment > ALIGN_SIZE)
+	{
+		search += alignment + ALIGN_GAP_MIN;
+	}
+
+	// A pool's single block must land in a list at or above the one searched,
+	// which is up to one second-level step above the request.
+	return (search - size) + (search >> SL_INDEX_COUNT_LOG2) +
+		(2 * BLOCK_HEADER_SIZE) + (2 * ALIGN_SIZE);
+}
+
+bool tlsf_add_pool(TlsfControl* control, void* mem, const size_t size)
+{
+	const uintptr_t start =
+		((uintptr_t)mem + ALIGN_SIZE - 1) & ~(uintptr_t)(ALIGN_SIZE - 1);
+	const uintptr_t end = ((uintptr_t)mem + size) & ~(uintptr_t)(ALIGN_SIZE - 1);
+	if (end < start + (2 * BLOCK_HEADER_SIZE) + BLOCK_SIZE_MIN)
+	{
+		return false;
+	}
+
+	const size_t pool_size = end - start - (2 * BLOCK_HEADER_SIZE);
+	if (pool_size >= BLOCK_SIZE_MAX)
+	{
+		return false;
+	}
+
+	TlsfBlock* block = (TlsfBlock*)start;
+	block->prev_phys = nullptr;
+	block->size = pool_size | BLOCK_FREE_BIT;
+
+	// A zero-sized, used sentinel terminates the pool.
+	TlsfBlock* sentinel = next_block(block);
+	sentinel->prev_phys = block;
+	sentinel->size = BLOCK_PREV_FREE_BIT;
+
+	insert_free_block(control, block);
+	return true;
+}
+
+void tlsf_remove_pool(TlsfControl* control, void* mem)
+{
+	TlsfBlock* block =
+		(TlsfBlock*)(((uintptr_t)mem + ALIGN_SIZE - 1) & ~(uintptr_t)(ALIGN_SIZE - 1));
+	remove_free_block(control, block);
+}
+
+void* tlsf_request_memory(
+	TlsfControl* control, const size_t size, const uint8_t alignment)
+{
+	const size_t adjusted = adjust_request_size(size);
+	if (adjusted == 0)
+	{
+		return nullptr;
+	}
+
+	// Payloads are naturally ALIGN_SIZE aligned. Larger alignments over-request
+	// so the payload can be moved forward, leaving a free block in front of it.
+	const bool over_aligned = alignment > ALIGN_SIZE;
+	size_t search = adjusted;
+	if (over_aligned)
+	{
+		search = adjust_request_size(adjusted + alignment + ALIGN_GAP_MIN);
+		if (search == 0)
+		{
+			return nullptr;
+		}
+	}
+
+	uint8_t fl;
+	uint8_t sl;
+	mapping_search(search, fl, sl);
+	TlsfBlock* block = search_suitable_block(control, fl, sl);
+	if (block == nullptr)
+	{
+		return nullptr;
+	}
+
+	remove_free_block(control, block);
+
+	if (over_aligned)
+	{
+		const uintptr_t payload = (uintptr_t)block_to_ptr(block);
+		const uintptr_t mask = (uintptr_t)alignment - 1;
+		uintptr_t aligned = (payload + mask) & ~mask;
+		if (aligned != payload && aligned - payload < ALIGN_GAP_MIN)
+		{
+			aligned = (payload + ALIGN_GAP_MIN + mask) & ~mask;
+		}
+
+		// Split off the gap as its own free block. Its neighbour before it
+		// cannot be free, so its flags carry over unchanged.
+		const size_t gap = aligned - payload;
+		if (gap != 0)
+		{
+			TlsfBlock* aligned_block = ptr_to_block((void*)aligned);
+			aligned_block->prev_phys = block;
+			aligned_block->size =
+				(block_size(block) - gap) | BLOCK_FREE_BIT | BLOCK_PREV_FREE_BIT;
+			next_block(aligned_block)->prev_phys = aligned_block;
+
+			set_block_size(block, gap - BLOCK_HEADER_SIZE);
+			insert_free_block(control, block);
+			block = aligned_block;
+		}
+	}
+
+	trim_free_block(control, block, adjusted);
+
+	block->size &= ~BLOCK_FREE_BIT;
+	next_block(block)->size &= ~BLOCK_PREV_FREE_BIT;
+	return block_to_ptr(block);
+}
+
+void tlsf_free_memory(TlsfControl* control, void* ptr)
+{
+	TlsfBlock* block = ptr_to_block(ptr);
+	block->size |= BLOCK_FREE_BIT;
+
+	// Merge with the previous block, which keeps its own flags.
+	if (block->size & BLOCK_PREV_FREE_BIT)
+	{
+		TlsfBlock* prev = block->prev_phys;
+		remove_free_block(control, prev);
+		set_block_size(prev, block_size(prev) + BLOCK_HEADER_SIZE + block_size(block));
+		block = prev;
+	}
+
+	// Merge with the next block.
+	TlsfBlock* next = next_block(block);
+	if (next->size & BLOCK_FREE_BIT)
+	{
+		remove_free_block(control, next);
+		set_block_size(block, block_size(block) + BLOCK_HEADER_SIZE + block_size(next));
+		next = next_block(block);
+	}
+
+	next->prev_phys = block;
+	next->size |= BLOCK_PREV_FREE_BIT;
+	insert_free_block(control, block);
+}
+
+size_t tlsf_block_size(const void* ptr)
+{
+	return block_size(ptr_to_block(ptr));
+}
+
+} // namespace mem_arena_handler
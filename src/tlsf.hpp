@@ -0,0 +1,64 @@
+#ifndef TLSF_HPP
+#define TLSF_HPP
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace mem_arena_handler
+{
+
+struct TlsfControl;
+
+/**
+ * @brief Allocates an empty TLSF control structure, or returns nullptr on OOM.
+ **/
+[[nodiscard]]
+TlsfControl* tlsf_create_control();
+
+void tlsf_destroy_control(TlsfControl* control);
+
+/**
+ * @brief Returns how many bytes a pool needs on top of `size` to be able to serve
+ * a single request of `size` bytes at `alignment`.
+ **/
+[[nodiscard]]
+size_t tlsf_pool_overhead(const size_t size, const uint8_t alignment);
+
+/**
+ * @brief Hands `mem` over to TLSF as a single free block, bounded by a sentinel
+ * so it never coalesces with memory outside of it.
+ *
+ * Returns false if the region is too small or too large to be managed.
+ **/
+[[nodiscard]]
+bool tlsf_add_pool(TlsfControl* control, void* mem, const size_t size);
+
+/**
+ * @brief Takes the pool added at `mem` back from TLSF. Every allocation in it must
+ * have been freed.
+ **/
+void tlsf_remove_pool(TlsfControl* control, void* mem);
+
+/**
+ * @brief Allocates `size` bytes at `alignment` in O(1), or returns nullptr if no
+ * free block is large enough.
+ **/
+[[nodiscard]]
+void* tlsf_request_memory(
+	TlsfControl* control, const size_t size, const uint8_t alignment);
+
+/**
+ * @brief Returns the block owning `ptr` to TLSF, coalescing it with free
+ * physical neighbours in O(1).
+ **/
+void tlsf_free_memory(TlsfControl* control, void* ptr);
+
+/**
+ * @brief Returns the usable size of the allocation at `ptr`.
+ **/
+[[nodiscard]]
+size_t tlsf_block_size(const void* ptr);
+
+} // namespace mem_arena_handler
+
+#endif // TLSF_HPP